@@ -0,0 +1,462 @@
+/*
+ *  colormap.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Histogram based color mapping of gwyexport, computed in linear time
+ *  without sorting the data, and the mapping of single rows used to
+ *  render images in bands
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <glib.h>
+
+#include <libgwyddion/gwyddion.h>
+#include <libprocess/gwyprocess.h>
+#include <libdraw/gwygradient.h>
+
+#include "colormap.h"
+
+/* Bin of a value, the maximum falls into the last bin and values out
+   of the range into the bin of the nearer end */
+#define HIST_BIN(hist, v, q) hist_bin(((v) - (hist)->min)*(q))
+
+/* The bin of a percentile is binned again at most this many times */
+#define REFINE_LEVELS 2
+
+/* Percent of the values at either end left out of the range of the
+   histograms of color_histogram_new_robust() */
+#define ROBUST_TAIL 0.1
+
+static inline gint
+hist_bin(gdouble t)
+{
+    if (!(t > 0.0))
+        return 0;
+    if (t >= COLORMAP_BINS - 1)
+        return COLORMAP_BINS - 1;
+    return (gint)t;
+}
+
+/**
+ * color_histogram_new:
+ * @dfield: A data field.
+ *
+ * Bins the values of the data field between its minimum and maximum in
+ * a single pass.
+ *
+ * Returns: A newly allocated histogram.
+ */
+ColorHistogram*
+color_histogram_new(GwyDataField *dfield)
+{
+    gdouble min, max;
+
+    gwy_data_field_get_min_max(dfield, &min, &max);
+    return color_histogram_new_range(dfield, min, max);
+}
+
+/**
+ * color_histogram_new_range:
+ * @dfield: A data field.
+ * @min: The start of the range, usually the minimum of the data field.
+ * @max: The end of the range, usually the maximum of the data field.
+ *
+ * Bins the values of the data field whose extremes are already known,
+ * e.g. from stats_compute(). Values out of the range are counted in the
+ * bin of the nearer end.
+ *
+ * Returns: A newly allocated histogram.
+ */
+ColorHistogram*
+color_histogram_new_range(GwyDataField *dfield, gdouble min, gdouble max)
+{
+    ColorHistogram *hist;
+    const gdouble *d;
+    gdouble q;
+    gint i, n;
+
+    hist = g_new0(ColorHistogram, 1);
+    hist->min = min;
+    hist->max = max;
+    n = gwy_data_field_get_xres(dfield)*gwy_data_field_get_yres(dfield);
+    hist->n = n;
+    if (hist->max <= hist->min) {
+        hist->bins[0] = n;
+        return hist;
+    }
+
+    d = gwy_data_field_get_data_const(dfield);
+    q = COLORMAP_BINS/(hist->max - hist->min);
+    for (i = 0; i < n; i++)
+        hist->bins[HIST_BIN(hist, d[i], q)]++;
+
+    return hist;
+}
+
+/**
+ * color_histogram_new_robust:
+ * @dfield: A data field.
+ * @min: The minimum of the data field.
+ * @max: The maximum of the data field.
+ *
+ * Bins the values of the data field over the range holding all but
+ * ROBUST_TAIL percent of them at either end, if that is much narrower
+ * than the full range. A few outliers then do not squeeze the data into
+ * a few bins. The outliers are counted in the end bins.
+ *
+ * Returns: A newly allocated histogram.
+ */
+ColorHistogram*
+color_histogram_new_robust(GwyDataField *dfield, gdouble min, gdouble max)
+{
+    ColorHistogram *hist;
+    gdouble lo, hi;
+
+    hist = color_histogram_new_range(dfield, min, max);
+    lo = color_histogram_percentile(hist, dfield, ROBUST_TAIL);
+    hi = color_histogram_percentile(hist, dfield, 100.0 - ROBUST_TAIL);
+    if (hi > lo && hi - lo < (max - min)/16.0) {
+        color_histogram_free(hist);
+        hist = color_histogram_new_range(dfield, lo, hi);
+    }
+    return hist;
+}
+
+void
+color_histogram_free(ColorHistogram *hist)
+{
+    g_free(hist);
+}
+
+/* Accumulated histograms are scaled down to at most this many values */
+#define ACCUMULATED_MAX_COUNT 2e9
+
+/**
+ * color_accumulator_new:
+ *
+ * Creates an empty histogram to accumulate the values of many data
+ * fields into, with a fixed size whatever their number.
+ *
+ * Returns: A newly allocated accumulator.
+ */
+ColorAccumulator*
+color_accumulator_new(void)
+{
+    return g_new0(ColorAccumulator, 1);
+}
+
+void
+color_accumulator_free(ColorAccumulator *acc)
+{
+    g_free(acc);
+}
+
+/* Rebins acc on bins 2^k times wider, with the least k covering
+   [lo, hi] and the values already binned. The new bin edges are old
+   ones, so the old bins merge exactly into the new ones. */
+static void
+color_accumulator_grow(ColorAccumulator *acc, gdouble lo, gdouble hi)
+{
+    guint64 *bins;
+    gdouble w, min;
+    gint64 m;
+    gint j, k, first, last;
+
+    w = (acc->max - acc->min)/COLORMAP_BINS;
+    for (first = 0; !acc->bins[first]; first++)
+        ;
+    for (last = COLORMAP_BINS - 1; !acc->bins[last]; last--)
+        ;
+    lo = MIN(lo, acc->min + first*w);
+    hi = MAX(hi, acc->min + (last + 1)*w);
+    for (k = 0; COLORMAP_BINS*ldexp(w, k) < hi - lo; k++)
+        ;
+    for (; ; k++) {
+        m = (gint64)floor((lo - acc->min)/ldexp(w, k));
+        min = acc->min + m*ldexp(w, k);
+        if (min + COLORMAP_BINS*ldexp(w, k) >= hi)
+            break;
+    }
+
+    bins = g_new0(guint64, COLORMAP_BINS);
+    for (j = first; j <= last; j++) {
+        bins[CLAMP((k < 63 ? j >> k : 0) - m, 0, COLORMAP_BINS - 1)]
+            += acc->bins[j];
+    }
+    memcpy(acc->bins, bins, sizeof(acc->bins));
+    g_free(bins);
+    acc->min = min;
+    acc->max = min + COLORMAP_BINS*ldexp(w, k);
+}
+
+/**
+ * color_accumulator_add:
+ * @acc: An accumulator.
+ * @dfield: A data field.
+ * @min: The start of the range of the data field to resolve.
+ * @max: The end of the range of the data field to resolve.
+ *
+ * Bins the values of the data field into the accumulator, whose range
+ * first grows by powers of two to cover [@min, @max] if needed. Values
+ * out of the range of the accumulator are counted in the bin of the
+ * nearer end. Every field is binned from its values on the same bins,
+ * and the bins are less than four times the union of the ranges over
+ * COLORMAP_BINS wide, whatever the order of the fields.
+ */
+void
+color_accumulator_add(ColorAccumulator *acc, GwyDataField *dfield,
+                      gdouble min, gdouble max)
+{
+    const gdouble *d;
+    gdouble q;
+    gint i, n;
+
+    if (!(max > min))
+        max = min + MAX(fabs(min)*DBL_EPSILON*COLORMAP_BINS,
+                        G_MINDOUBLE);
+    if (!acc->n) {
+        acc->min = min;
+        acc->max = max;
+    } else if (min < acc->min || max > acc->max) {
+        color_accumulator_grow(acc, min, max);
+    }
+
+    d = gwy_data_field_get_data_const(dfield);
+    n = gwy_data_field_get_xres(dfield)*gwy_data_field_get_yres(dfield);
+    q = COLORMAP_BINS/(acc->max - acc->min);
+    for (i = 0; i < n; i++)
+        acc->bins[HIST_BIN(acc, d[i], q)]++;
+    acc->n += n;
+}
+
+/**
+ * color_accumulator_histogram:
+ * @acc: An accumulator.
+ *
+ * Converts the accumulated values into a histogram, with the counts
+ * scaled down if their total would overflow.
+ *
+ * Returns: A newly allocated histogram.
+ */
+ColorHistogram*
+color_accumulator_histogram(const ColorAccumulator *acc)
+{
+    ColorHistogram *hist;
+    gdouble f;
+    gint k;
+
+    hist = g_new0(ColorHistogram, 1);
+    hist->min = acc->min;
+    hist->max = acc->max;
+    f = acc->n > ACCUMULATED_MAX_COUNT ? ACCUMULATED_MAX_COUNT/acc->n : 1.0;
+    for (k = 0; k < COLORMAP_BINS; k++) {
+        hist->bins[k] = (guint)(f*acc->bins[k] + 0.5);
+        hist->n += hist->bins[k];
+    }
+    return hist;
+}
+
+/**
+ * color_histogram_percentile:
+ * @hist: A histogram.
+ * @dfield: The data field of the histogram, or %NULL.
+ * @p: Percentile, from 0 to 100.
+ *
+ * Finds the bin of the percentile and interpolates linearly within it.
+ * With the data field, a bin holding more than its share of the values
+ * is binned again from the data, up to REFINE_LEVELS times. Each level
+ * is a pass over the data counting only the values of that bin, so
+ * data squeezed into a few bins by outliers are resolved without
+ * copying them.
+ *
+ * Returns: The value below which @p percent of the data lie.
+ */
+gdouble
+color_histogram_percentile(const ColorHistogram *hist,
+                           GwyDataField *dfield,
+                           gdouble p)
+{
+    ColorHistogram *sub = NULL;
+    const ColorHistogram *h = hist;
+    const gdouble *d;
+    gdouble rank, width, lo, hi, q, r = hist->max;
+    guint below = 0, cum;
+    gint i, j, n, level;
+
+    rank = CLAMP(p, 0.0, 100.0)/100.0*hist->n;
+    d = dfield ? gwy_data_field_get_data_const(dfield) : NULL;
+    n = dfield ? gwy_data_field_get_xres(dfield)
+                 *gwy_data_field_get_yres(dfield) : 0;
+
+    for (level = 0; ; level++) {
+        /* The bin of the rank, below counts the values under h->min */
+        cum = below;
+        for (i = 0; i < COLORMAP_BINS; i++) {
+            if (h->bins[i] && cum + h->bins[i] >= rank)
+                break;
+            cum += h->bins[i];
+        }
+        if (i == COLORMAP_BINS) {
+            r = h->max;
+            break;
+        }
+        width = (h->max - h->min)/COLORMAP_BINS;
+        if (!dfield || level == REFINE_LEVELS || width <= 0.0
+            || h->bins[i] <= hist->n/COLORMAP_BINS) {
+            r = h->min + width*(i + (rank - cum)/h->bins[i]);
+            break;
+        }
+
+        /* Bin the values of the bin i again, the maximum falls into the
+           last bin so its upper end is closed */
+        lo = h->min + width*i;
+        hi = (i == COLORMAP_BINS - 1) ? h->max : lo + width;
+        if (!sub)
+            sub = g_new(ColorHistogram, 1);
+        memset(sub, 0, sizeof(ColorHistogram));
+        sub->min = lo;
+        sub->max = hi;
+        q = COLORMAP_BINS/(hi - lo);
+        below = 0;
+        for (j = 0; j < n; j++) {
+            if (d[j] < lo)
+                below++;
+            else if (d[j] <= hi)
+                sub->bins[HIST_BIN(sub, d[j], q)]++;
+        }
+        h = sub;
+    }
+
+    g_free(sub);
+    return r;
+}
+
+/**
+ * color_histogram_cdf:
+ * @hist: A histogram.
+ * @cdf: Array of COLORMAP_BINS + 1 to store the fraction of the data
+ *       below the start of each bin, and 1.
+ */
+void
+color_histogram_cdf(const ColorHistogram *hist, gdouble *cdf)
+{
+    guint below = 0;
+    gint k;
+
+    for (k = 0; k < COLORMAP_BINS; k++) {
+        cdf[k] = (gdouble)below/hist->n;
+        below += hist->bins[k];
+    }
+    cdf[COLORMAP_BINS] = 1.0;
+}
+
+/**
+ * colormap_map_equalized:
+ * @d: The values.
+ * @n: Number of values.
+ * @rgb: Location to store n RGB triplets.
+ * @samples: RGBA samples of the gradient.
+ * @nsamples: Number of the samples.
+ * @hist: Histogram of the data field the values come from.
+ * @cdf: Its cumulative distribution from color_histogram_cdf().
+ *
+ * Maps values to colors distributed evenly over the values through
+ * their cumulative distribution.
+ */
+void
+colormap_map_equalized(const gdouble *d, gint n, guchar *rgb,
+                       const guchar *samples, gint nsamples,
+                       const ColorHistogram *hist, const gdouble *cdf)
+{
+    const guchar *s;
+    gdouble q, t;
+    gint j, k;
+
+    q = hist->max > hist->min ? COLORMAP_BINS/(hist->max - hist->min) : 0.0;
+    for (j = 0; j < n; j++) {
+        t = (d[j] - hist->min)*q;
+        k = HIST_BIN(hist, d[j], q);
+        t = cdf[k] + (t - k)*(cdf[k+1] - cdf[k]);
+        s = samples + 4*(gint)(CLAMP(t, 0.0, 1.0)*(nsamples - 1) + 0.5);
+        *(rgb++) = s[0];
+        *(rgb++) = s[1];
+        *(rgb++) = s[2];
+    }
+}
+
+/**
+ * colormap_map_linear:
+ * @d: The values.
+ * @n: Number of values.
+ * @rgb: Location to store n RGB triplets.
+ * @samples: RGBA samples of the gradient.
+ * @nsamples: Number of the samples.
+ * @min: The value mapped to the start of the gradient.
+ * @max: The value mapped to the end of the gradient.
+ *
+ * Maps values linearly to colors, values out of the range get the
+ * colors of its ends.
+ */
+void
+colormap_map_linear(const gdouble *d, gint n, guchar *rgb,
+                    const guchar *samples, gint nsamples,
+                    gdouble min, gdouble max)
+{
+    const guchar *s;
+    gdouble q;
+    gint j;
+
+    q = max > min ? (nsamples - 1)/(max - min) : 0.0;
+    for (j = 0; j < n; j++) {
+        s = samples + 4*(gint)(CLAMP((d[j] - min)*q, 0.0, nsamples - 1.0)
+                               + 0.5);
+        *(rgb++) = s[0];
+        *(rgb++) = s[1];
+        *(rgb++) = s[2];
+    }
+}
+
+/**
+ * colormap_draw_equalized:
+ * @pixbuf: A pixbuf of the size of the data field.
+ * @dfield: A data field.
+ * @gradient: The color gradient.
+ * @hist: Histogram of the data field.
+ *
+ * Draws the data field with the colors distributed evenly over the
+ * values through their cumulative distribution.
+ */
+void
+colormap_draw_equalized(GdkPixbuf *pixbuf,
+                        GwyDataField *dfield,
+                        GwyGradient *gradient,
+                        const ColorHistogram *hist)
+{
+    gdouble cdf[COLORMAP_BINS + 1];
+    const guchar *samples;
+    const gdouble *d;
+    guchar *pixels;
+    gint xres, yres, rowstride, nsamples, i;
+
+    xres = gwy_data_field_get_xres(dfield);
+    yres = gwy_data_field_get_yres(dfield);
+    d = gwy_data_field_get_data_const(dfield);
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    samples = gwy_gradient_get_samples(gradient, &nsamples);
+
+    color_histogram_cdf(hist, cdf);
+    for (i = 0; i < yres; i++) {
+        colormap_map_equalized(d + i*xres, xres, pixels + i*rowstride,
+                               samples, nsamples, hist, cdf);
+    }
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -0,0 +1,80 @@
+/*
+ *  colormap.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Histogram based color mapping of gwyexport, computed in linear time
+ *  without sorting the data, and the mapping of single rows used to
+ *  render images in bands
+ *
+ */
+
+#ifndef __GWYEXPORT_COLORMAP_H__
+#define __GWYEXPORT_COLORMAP_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <libprocess/gwyprocess.h>
+#include <libdraw/gwygradient.h>
+
+/* Number of bins of the value histograms */
+#define COLORMAP_BINS 4096
+
+typedef struct {
+    gdouble min;
+    gdouble max;
+    guint n;
+    guint bins[COLORMAP_BINS];
+} ColorHistogram;
+
+/* Histogram of many data fields, see color_accumulator_add() */
+typedef struct {
+    gdouble min;
+    gdouble max;
+    guint64 n;
+    guint64 bins[COLORMAP_BINS];
+} ColorAccumulator;
+
+ColorHistogram*   color_histogram_new         (GwyDataField *dfield);
+ColorHistogram*   color_histogram_new_range   (GwyDataField *dfield,
+                                               gdouble min,
+                                               gdouble max);
+ColorHistogram*   color_histogram_new_robust  (GwyDataField *dfield,
+                                               gdouble min,
+                                               gdouble max);
+void              color_histogram_free        (ColorHistogram *hist);
+gdouble           color_histogram_percentile  (const ColorHistogram *hist,
+                                               GwyDataField *dfield,
+                                               gdouble p);
+void              color_histogram_cdf         (const ColorHistogram *hist,
+                                               gdouble *cdf);
+ColorAccumulator* color_accumulator_new       (void);
+void              color_accumulator_free      (ColorAccumulator *acc);
+void              color_accumulator_add       (ColorAccumulator *acc,
+                                               GwyDataField *dfield,
+                                               gdouble min,
+                                               gdouble max);
+ColorHistogram*   color_accumulator_histogram (const ColorAccumulator *acc);
+void              colormap_map_equalized      (const gdouble *d,
+                                               gint n,
+                                               guchar *rgb,
+                                               const guchar *samples,
+                                               gint nsamples,
+                                               const ColorHistogram *hist,
+                                               const gdouble *cdf);
+void              colormap_map_linear         (const gdouble *d,
+                                               gint n,
+                                               guchar *rgb,
+                                               const guchar *samples,
+                                               gint nsamples,
+                                               gdouble min,
+                                               gdouble max);
+void              colormap_draw_equalized     (GdkPixbuf *pixbuf,
+                                               GwyDataField *dfield,
+                                               GwyGradient *gradient,
+                                               const ColorHistogram *hist);
+
+#endif /* __GWYEXPORT_COLORMAP_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
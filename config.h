@@ -7,6 +7,18 @@
 /* Define to 1 if you have the <gwyddion.h> header file. */
 /* #undef HAVE_GWYDDION_H */
 
+/* Define to 1 if you have libwebp, set by the Makefile. */
+/* #undef HAVE_WEBP */
+
+/* Define to 1 if you have FFTW 3, set by the Makefile. */
+/* #undef HAVE_FFTW3 */
+
+/* Define to 1 if you have libpng, set by the Makefile. */
+/* #undef HAVE_LIBPNG */
+
+/* Define to 1 if you have libjpeg, set by the Makefile. */
+/* #undef HAVE_LIBJPEG */
+
 /* Define to 1 if you have the <inttypes.h> header file. */
 #define HAVE_INTTYPES_H 1
 
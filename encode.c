@@ -0,0 +1,502 @@
+/*
+ *  encode.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Encoding of the rendered images to the output file formats. JPEG
+ *  and PNG go through gdk-pixbuf, QOI is encoded here and lossless
+ *  WebP by libwebp when available. The latter two read the pixbuf
+ *  rows directly. With libpng and libjpeg, PNG and JPEG can also be
+ *  encoded from rows produced band by band, without a whole image.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include <config.h>
+#include "encode.h"
+
+#ifdef HAVE_WEBP
+#include <webp/encode.h>
+#endif
+#if defined(HAVE_LIBPNG) || defined(HAVE_LIBJPEG)
+#include <stdio.h>
+#include <setjmp.h>
+#endif
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+#define QOI_OP_INDEX  0x00
+#define QOI_OP_DIFF   0x40
+#define QOI_OP_LUMA   0x80
+#define QOI_OP_RUN    0xc0
+#define QOI_OP_RGB    0xfe
+#define QOI_HASH(r, g, b) (((r)*3 + (g)*5 + (b)*7 + 255*11) % 64)
+
+/* Compressed JPEG data is collected in blocks of this size */
+#define JPEG_BLOCK 65536
+
+static const struct {
+    const gchar *name;
+    const gchar *extension;
+} formats[N_FORMATS] = {
+    { "jpg",  ".jpg"  },
+    { "png",  ".png"  },
+    { "qoi",  ".qoi"  },
+    { "webp", ".webp" },
+};
+
+gboolean
+encode_format_available(FileFormat format)
+{
+#ifndef HAVE_WEBP
+    if (format == WEBP)
+        return FALSE;
+#endif
+    return format >= 0 && format < N_FORMATS;
+}
+
+/* Returns N_FORMATS for unknown names */
+FileFormat
+encode_format_from_name(const gchar *name)
+{
+    gint i;
+
+    for (i = 0; i < N_FORMATS; i++) {
+        if (g_str_equal(name, formats[i].name))
+            return (FileFormat)i;
+    }
+    return N_FORMATS;
+}
+
+const gchar*
+encode_format_name(FileFormat format)
+{
+    return formats[format].name;
+}
+
+const gchar*
+encode_format_extension(FileFormat format)
+{
+    return formats[format].extension;
+}
+
+static void
+put_be32(guchar *p, guint32 v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* Encodes an RGB pixbuf to the QOI format, see https://qoiformat.org */
+static gboolean
+encode_qoi(GdkPixbuf *pixbuf, gchar **buffer, gsize *size)
+{
+    static const guchar padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    guint32 index[64], px;
+    guchar pr = 0, pg = 0, pb = 0, r, g, b, *out, *o;
+    const guchar *pixels, *p;
+    gint xres, yres, rowstride, nchannels, i, j, run = 0, h;
+    gint vr, vg, vb, vgr, vgb;
+
+    xres = gdk_pixbuf_get_width(pixbuf);
+    yres = gdk_pixbuf_get_height(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    nchannels = gdk_pixbuf_get_n_channels(pixbuf);
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+    /* The RGB op is the longest, four bytes per pixel */
+    out = g_malloc(14 + 4*(gsize)xres*yres + sizeof(padding));
+    memcpy(out, "qoif", 4);
+    put_be32(out + 4, xres);
+    put_be32(out + 8, yres);
+    out[12] = 3;
+    out[13] = 0;
+    o = out + 14;
+    memset(index, 0, sizeof(index));
+
+    for (i = 0; i < yres; i++) {
+        p = pixels + i*rowstride;
+        for (j = 0; j < xres; j++, p += nchannels) {
+            r = p[0];
+            g = p[1];
+            b = p[2];
+            if (r == pr && g == pg && b == pb) {
+                if (++run == 62) {
+                    *(o++) = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run) {
+                *(o++) = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            /* Packed RGBA, the zeroed index never matches opaque pixels */
+            px = (guint32)r << 24 | (guint32)g << 16 | (guint32)b << 8 | 0xff;
+            h = QOI_HASH(r, g, b);
+            if (index[h] == px) {
+                *(o++) = QOI_OP_INDEX | h;
+            } else {
+                index[h] = px;
+                vr = (signed char)(r - pr);
+                vg = (signed char)(g - pg);
+                vb = (signed char)(b - pb);
+                vgr = vr - vg;
+                vgb = vb - vg;
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2
+                    && vb > -3 && vb < 2) {
+                    *(o++) = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2
+                             | (vb + 2);
+                } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32
+                           && vgb > -9 && vgb < 8) {
+                    *(o++) = QOI_OP_LUMA | (vg + 32);
+                    *(o++) = (vgr + 8) << 4 | (vgb + 8);
+                } else {
+                    *(o++) = QOI_OP_RGB;
+                    *(o++) = r;
+                    *(o++) = g;
+                    *(o++) = b;
+                }
+            }
+            pr = r;
+            pg = g;
+            pb = b;
+        }
+    }
+    if (run)
+        *(o++) = QOI_OP_RUN | (run - 1);
+    memcpy(o, padding, sizeof(padding));
+    o += sizeof(padding);
+
+    *buffer = (gchar*)out;
+    *size = o - out;
+    return TRUE;
+}
+
+#ifdef HAVE_WEBP
+static gboolean
+encode_webp(GdkPixbuf *pixbuf, gchar **buffer, gsize *size)
+{
+    uint8_t *out = NULL;
+    size_t n;
+
+    if (gdk_pixbuf_get_has_alpha(pixbuf))
+        n = WebPEncodeLosslessRGBA(gdk_pixbuf_get_pixels(pixbuf),
+                                   gdk_pixbuf_get_width(pixbuf),
+                                   gdk_pixbuf_get_height(pixbuf),
+                                   gdk_pixbuf_get_rowstride(pixbuf), &out);
+    else
+        n = WebPEncodeLosslessRGB(gdk_pixbuf_get_pixels(pixbuf),
+                                  gdk_pixbuf_get_width(pixbuf),
+                                  gdk_pixbuf_get_height(pixbuf),
+                                  gdk_pixbuf_get_rowstride(pixbuf), &out);
+    if (!n) {
+        WebPFree(out);
+        return FALSE;
+    }
+
+    /* Callers release the buffer with g_free(), the one of libwebp must
+       go back to its own allocator */
+    *buffer = g_malloc(n);
+    memcpy(*buffer, out, n);
+    *size = n;
+    WebPFree(out);
+    return TRUE;
+}
+#endif
+
+/**
+ * encode_pixbuf:
+ * @pixbuf: An RGB pixbuf.
+ * @format: The output file format.
+ * @buffer: Location to store the encoded image, free with g_free().
+ * @size: Location to store the size of the encoded image.
+ *
+ * Returns: Whether the image could be encoded.
+ */
+gboolean
+encode_pixbuf(GdkPixbuf *pixbuf,
+              FileFormat format,
+              gchar **buffer,
+              gsize *size)
+{
+    /* gdk-pixbuf loads its savers lazily without guarding it, so its
+       saves are serialized when images are encoded on several threads */
+    static GMutex save_lock;
+    gboolean ok;
+
+    switch(format){
+        case PNG:
+            g_mutex_lock(&save_lock);
+            ok = gdk_pixbuf_save_to_buffer(pixbuf, buffer, size,
+                                           "png", NULL,
+                                           "compression",
+                                           G_STRINGIFY(ENCODE_PNG_COMPRESSION),
+                                           NULL);
+            g_mutex_unlock(&save_lock);
+            return ok;
+        case JPEG:
+            g_mutex_lock(&save_lock);
+            ok = gdk_pixbuf_save_to_buffer(pixbuf, buffer, size,
+                                           "jpeg", NULL,
+                                           "quality",
+                                           G_STRINGIFY(ENCODE_JPEG_QUALITY),
+                                           NULL);
+            g_mutex_unlock(&save_lock);
+            return ok;
+        case QOI:
+            return encode_qoi(pixbuf, buffer, size);
+#ifdef HAVE_WEBP
+        case WEBP:
+            return encode_webp(pixbuf, buffer, size);
+#endif
+        default:
+        break;
+    }
+    return FALSE;
+}
+
+#ifdef HAVE_LIBPNG
+static void
+png_write_buffer(png_structp png, png_bytep data, png_size_t length)
+{
+    g_string_append_len((GString*)png_get_io_ptr(png),
+                        (const gchar*)data, length);
+}
+
+static void
+png_flush_buffer(png_structp png)
+{
+}
+
+static gboolean
+encode_png_rows(gint width, gint height, gint band,
+                EncodeRowsFunc func, gpointer user_data,
+                guchar *rgb, FILE *fp, GString *buf)
+{
+    png_structp png;
+    png_infop info = NULL;
+    gint i, k, n;
+
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png)
+        return FALSE;
+    info = png_create_info_struct(png);
+    if (!info) {
+        png_destroy_write_struct(&png, NULL);
+        return FALSE;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return FALSE;
+    }
+
+    if (fp)
+        png_init_io(png, fp);
+    else
+        png_set_write_fn(png, buf, png_write_buffer, png_flush_buffer);
+    png_set_compression_level(png, ENCODE_PNG_COMPRESSION);
+    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    for (i = 0; i < height; i += n) {
+        n = MIN(band, height - i);
+        func(user_data, i, n, rgb);
+        for (k = 0; k < n; k++)
+            png_write_row(png, rgb + (gsize)3*width*k);
+    }
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    return TRUE;
+}
+#endif
+
+#ifdef HAVE_LIBJPEG
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+} JpegError;
+
+/* Destination appending to a GString */
+typedef struct {
+    struct jpeg_destination_mgr pub;
+    GString *buf;
+    JOCTET block[JPEG_BLOCK];
+} JpegDest;
+
+static void
+jpeg_error_exit(j_common_ptr cinfo)
+{
+    longjmp(((JpegError*)cinfo->err)->jmp, 1);
+}
+
+static void
+jpeg_init_buffer(j_compress_ptr cinfo)
+{
+    JpegDest *dest = (JpegDest*)cinfo->dest;
+
+    dest->pub.next_output_byte = dest->block;
+    dest->pub.free_in_buffer = JPEG_BLOCK;
+}
+
+static boolean
+jpeg_empty_buffer(j_compress_ptr cinfo)
+{
+    JpegDest *dest = (JpegDest*)cinfo->dest;
+
+    g_string_append_len(dest->buf, (const gchar*)dest->block, JPEG_BLOCK);
+    jpeg_init_buffer(cinfo);
+    return TRUE;
+}
+
+static void
+jpeg_term_buffer(j_compress_ptr cinfo)
+{
+    JpegDest *dest = (JpegDest*)cinfo->dest;
+
+    g_string_append_len(dest->buf, (const gchar*)dest->block,
+                        JPEG_BLOCK - dest->pub.free_in_buffer);
+}
+
+static gboolean
+encode_jpeg_rows(gint width, gint height, gint band,
+                 EncodeRowsFunc func, gpointer user_data,
+                 guchar *rgb, FILE *fp, GString *buf)
+{
+    struct jpeg_compress_struct cinfo;
+    JpegError jerr;
+    JpegDest *dest = NULL;
+    JSAMPROW row;
+    gint i, k, n;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (!fp)
+        dest = g_new(JpegDest, 1);
+    if (setjmp(jerr.jmp)) {
+        jpeg_destroy_compress(&cinfo);
+        g_free(dest);
+        return FALSE;
+    }
+    jpeg_create_compress(&cinfo);
+
+    if (fp) {
+        jpeg_stdio_dest(&cinfo, fp);
+    } else {
+        dest->pub.init_destination = jpeg_init_buffer;
+        dest->pub.empty_output_buffer = jpeg_empty_buffer;
+        dest->pub.term_destination = jpeg_term_buffer;
+        dest->buf = buf;
+        cinfo.dest = &dest->pub;
+    }
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, ENCODE_JPEG_QUALITY, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    for (i = 0; i < height; i += n) {
+        n = MIN(band, height - i);
+        func(user_data, i, n, rgb);
+        for (k = 0; k < n; k++) {
+            row = rgb + (gsize)3*width*k;
+            jpeg_write_scanlines(&cinfo, &row, 1);
+        }
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    g_free(dest);
+    return TRUE;
+}
+#endif
+
+/* Whether encode_rows() supports the format in this build */
+gboolean
+encode_rows_available(FileFormat format)
+{
+#ifdef HAVE_LIBPNG
+    if (format == PNG)
+        return TRUE;
+#endif
+#ifdef HAVE_LIBJPEG
+    if (format == JPEG)
+        return TRUE;
+#endif
+    return FALSE;
+}
+
+/**
+ * encode_rows:
+ * @width: Width of the image.
+ * @height: Height of the image.
+ * @band: Number of rows produced at once.
+ * @format: The output file format, PNG or JPEG.
+ * @func: Function filling the next band of RGB rows.
+ * @user_data: Data passed to @func.
+ * @fp: File to write the image to, or %NULL to encode it in memory.
+ * @buffer: Location to store the encoded image if @fp is %NULL, free
+ *          with g_free().
+ * @size: Location to store the size of the encoded image.
+ *
+ * Encodes an image whose rows are produced band by band, so only one
+ * band of RGB data exists at any time.
+ *
+ * Returns: Whether the image could be encoded.
+ */
+gboolean
+encode_rows(gint width, gint height, gint band,
+            FileFormat format,
+            EncodeRowsFunc func, gpointer user_data,
+            FILE *fp, gchar **buffer, gsize *size)
+{
+    GString *buf = NULL;
+    guchar *rgb;
+    gboolean ok = FALSE;
+
+    g_return_val_if_fail(band > 0, FALSE);
+
+    if (!fp)
+        buf = g_string_new(NULL);
+    rgb = g_new(guchar, (gsize)3*width*MIN(band, height));
+    switch(format){
+#ifdef HAVE_LIBPNG
+        case PNG:
+            ok = encode_png_rows(width, height, band, func, user_data,
+                                 rgb, fp, buf);
+            break;
+#endif
+#ifdef HAVE_LIBJPEG
+        case JPEG:
+            ok = encode_jpeg_rows(width, height, band, func, user_data,
+                                  rgb, fp, buf);
+            break;
+#endif
+        default:
+            break;
+    }
+    g_free(rgb);
+
+    if (buf && ok) {
+        *size = buf->len;
+        *buffer = g_string_free(buf, FALSE);
+    } else if (buf) {
+        g_string_free(buf, TRUE);
+    }
+    return ok;
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -0,0 +1,55 @@
+/*
+ *  encode.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Encoding of the rendered images to the output file formats
+ *
+ */
+
+#ifndef __GWYEXPORT_ENCODE_H__
+#define __GWYEXPORT_ENCODE_H__
+
+#include <stdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+typedef enum{
+    JPEG,
+    PNG,
+    QOI,
+    WEBP,
+    N_FORMATS
+} FileFormat;
+
+/* Settings of the PNG and JPEG encoders */
+#define ENCODE_PNG_COMPRESSION 9
+#define ENCODE_JPEG_QUALITY 90
+
+/* Fills n rows from row `from' as RGB triplets into rgb */
+typedef void (*EncodeRowsFunc)(gpointer user_data, gint from, gint n,
+                               guchar *rgb);
+
+gboolean     encode_format_available (FileFormat format);
+FileFormat   encode_format_from_name (const gchar *name);
+const gchar* encode_format_name      (FileFormat format);
+const gchar* encode_format_extension (FileFormat format);
+gboolean     encode_pixbuf           (GdkPixbuf *pixbuf,
+                                      FileFormat format,
+                                      gchar **buffer,
+                                      gsize *size);
+gboolean     encode_rows_available   (FileFormat format);
+gboolean     encode_rows             (gint width,
+                                      gint height,
+                                      gint band,
+                                      FileFormat format,
+                                      EncodeRowsFunc func,
+                                      gpointer user_data,
+                                      FILE *fp,
+                                      gchar **buffer,
+                                      gsize *size);
+
+#endif /* __GWYEXPORT_ENCODE_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
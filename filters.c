@@ -0,0 +1,491 @@
+/*
+ *  filters.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Built-in data field filters of gwyexport which run in place and
+ *  split the work across rows on all processors
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include <libgwyddion/gwyddion.h>
+#include <libprocess/gwyprocess.h>
+
+#ifdef HAVE_FFTW3
+#include <fftw3.h>
+#endif
+
+#include "filters.h"
+
+/* The median works on data quantized to this many levels */
+#define MEDIAN_LEVELS 65536
+
+/* The Gaussian kernel is cut off at this many sigmas */
+#define GAUSS_EXTENT 3.0
+
+typedef struct {
+    RowBlockFunc func;
+    gpointer user_data;
+    gint from;
+    gint to;
+} RowBlock;
+
+typedef struct {
+    gint xres;
+    gint yres;
+    const gdouble *src;
+    gdouble *tmp;
+    gdouble *dest;
+    const gdouble *kernel;
+    gint radius;
+} GaussData;
+
+typedef struct {
+    gint xres;
+    gint yres;
+    gint size;
+    const guint16 *levels;
+    gdouble *dest;
+    gdouble min;
+    gdouble step;
+} MedianData;
+
+typedef struct {
+    gint xres;
+    gint yres;
+    /* Columns of the spectrum, the real and imaginary parts of its
+       elements are step doubles apart */
+    gint cols;
+    gint step;
+    gdouble *re;
+    gdouble *im;
+    gdouble cutoff;
+    /* Normalization of the backward transform */
+    gdouble norm;
+} HighpassData;
+
+#ifdef HAVE_FFTW3
+/* Sizes whose high-pass plans are kept, all are dropped when full */
+#define HIGHPASS_PLANS 8
+
+typedef struct {
+    gint xres;
+    gint yres;
+    fftw_plan forward;
+    fftw_plan backward;
+} HighpassPlan;
+
+/* The FFTW planner is not thread safe, the lock guards the plans */
+static GMutex highpass_lock;
+static HighpassPlan highpass_plans[HIGHPASS_PLANS];
+static gint n_highpass_plans = 0;
+#endif
+
+static gpointer
+row_block_thread(gpointer p)
+{
+    RowBlock *block = (RowBlock*)p;
+
+    block->func(block->user_data, block->from, block->to);
+    return NULL;
+}
+
+/** Calls func on consecutive blocks of rows [from, to), one block per
+ *  processor, and waits for all of them
+ */
+void
+run_row_blocks(RowBlockFunc func, gpointer user_data, gint nrows)
+{
+    RowBlock *blocks;
+    GThread **threads;
+    gint i, n;
+
+    n = CLAMP((gint)g_get_num_processors(), 1, nrows);
+    if (n == 1) {
+        func(user_data, 0, nrows);
+        return;
+    }
+
+    blocks = g_new(RowBlock, n);
+    threads = g_new(GThread*, n);
+    for (i = 0; i < n; i++) {
+        blocks[i].func = func;
+        blocks[i].user_data = user_data;
+        blocks[i].from = (gint)((gint64)nrows*i/n);
+        blocks[i].to = (gint)((gint64)nrows*(i + 1)/n);
+    }
+    for (i = 1; i < n; i++)
+        threads[i] = g_thread_new("filter", row_block_thread, blocks + i);
+    row_block_thread(blocks);
+    for (i = 1; i < n; i++)
+        g_thread_join(threads[i]);
+
+    g_free(threads);
+    g_free(blocks);
+}
+
+/* Horizontal pass, edges are extended by the border pixels */
+static void
+gauss_rows(gpointer user_data, gint from, gint to)
+{
+    GaussData *gd = (GaussData*)user_data;
+    const gdouble *row;
+    gdouble *t, s;
+    gint i, j, k, xres = gd->xres, r = gd->radius;
+
+    for (i = from; i < to; i++) {
+        row = gd->src + i*xres;
+        t = gd->tmp + i*xres;
+        for (j = 0; j < xres; j++) {
+            s = 0.0;
+            if (j >= r && j + r < xres) {
+                for (k = -r; k <= r; k++)
+                    s += gd->kernel[k + r]*row[j + k];
+            } else {
+                for (k = -r; k <= r; k++)
+                    s += gd->kernel[k + r]*row[CLAMP(j + k, 0, xres - 1)];
+            }
+            t[j] = s;
+        }
+    }
+}
+
+/* Vertical pass, whole rows are accumulated to run over contiguous
+   memory */
+static void
+gauss_columns(gpointer user_data, gint from, gint to)
+{
+    GaussData *gd = (GaussData*)user_data;
+    const gdouble *row;
+    gdouble *d, w;
+    gint i, j, k, xres = gd->xres, yres = gd->yres, r = gd->radius;
+
+    for (i = from; i < to; i++) {
+        d = gd->dest + i*xres;
+        memset(d, 0, xres*sizeof(gdouble));
+        for (k = -r; k <= r; k++) {
+            w = gd->kernel[k + r];
+            row = gd->tmp + CLAMP(i + k, 0, yres - 1)*xres;
+            for (j = 0; j < xres; j++)
+                d[j] += w*row[j];
+        }
+    }
+}
+
+/**
+ * filter_gaussian:
+ * @dfield: A data field.
+ * @sigma: Standard deviation of the Gaussian in pixels.
+ *
+ * Smooths the data field with a separable Gaussian kernel.
+ */
+void
+filter_gaussian(GwyDataField *dfield, gdouble sigma)
+{
+    GaussData gd;
+    gdouble *kernel, s;
+    gint k;
+
+    g_return_if_fail(sigma > 0.0);
+
+    gd.xres = gwy_data_field_get_xres(dfield);
+    gd.yres = gwy_data_field_get_yres(dfield);
+    gd.radius = MAX((gint)ceil(GAUSS_EXTENT*sigma), 1);
+
+    kernel = g_new(gdouble, 2*gd.radius + 1);
+    s = 0.0;
+    for (k = -gd.radius; k <= gd.radius; k++)
+        s += kernel[k + gd.radius] = exp(-0.5*k*k/(sigma*sigma));
+    for (k = 0; k < 2*gd.radius + 1; k++)
+        kernel[k] /= s;
+
+    gd.kernel = kernel;
+    gd.dest = gwy_data_field_get_data(dfield);
+    gd.src = gd.dest;
+    gd.tmp = g_new(gdouble, gd.xres*gd.yres);
+    run_row_blocks(gauss_rows, &gd, gd.yres);
+    run_row_blocks(gauss_columns, &gd, gd.yres);
+
+    g_free(gd.tmp);
+    g_free(kernel);
+    gwy_data_field_invalidate(dfield);
+    gwy_data_field_data_changed(dfield);
+}
+
+/* Huang's sliding histogram median. The window moves along a row by
+   adding the entering column and removing the leaving one, and the
+   median level is tracked together with the count of values below it,
+   so each step costs O(size) whatever the window area. */
+static void
+median_rows(gpointer user_data, gint from, gint to)
+{
+    MedianData *md = (MedianData*)user_data;
+    const guint16 *q = md->levels;
+    guint *hist;
+    gint xres = md->xres, yres = md->yres, half = md->size/2;
+    gint i, ii, i0, i1, j, c, n, r, med = 0, below = 0;
+
+    hist = g_new0(guint, MEDIAN_LEVELS);
+
+#define ADD_COLUMN(col) \
+    for (ii = i0; ii <= i1; ii++) { \
+        hist[q[ii*xres + (col)]]++; \
+        if (q[ii*xres + (col)] < med) below++; \
+    }
+#define REMOVE_COLUMN(col) \
+    for (ii = i0; ii <= i1; ii++) { \
+        hist[q[ii*xres + (col)]]--; \
+        if (q[ii*xres + (col)] < med) below--; \
+    }
+
+    for (i = from; i < to; i++) {
+        i0 = MAX(i - half, 0);
+        i1 = MIN(i - half + md->size - 1, yres - 1);
+        for (c = 0; c < MIN(md->size - half - 1, xres); c++) {
+            ADD_COLUMN(c);
+        }
+        for (j = 0; j < xres; j++) {
+            c = j - half + md->size - 1;
+            if (c < xres) {
+                ADD_COLUMN(c);
+            }
+            c = j - half - 1;
+            if (c >= 0) {
+                REMOVE_COLUMN(c);
+            }
+            n = (MIN(j - half + md->size - 1, xres - 1)
+                 - MAX(j - half, 0) + 1)*(i1 - i0 + 1);
+            r = (n - 1)/2;
+            while (below > r) {
+                med--;
+                below -= hist[med];
+            }
+            while (below + (gint)hist[med] <= r) {
+                below += hist[med];
+                med++;
+            }
+            md->dest[i*xres + j] = md->min + med*md->step;
+        }
+        /* Empty the histogram for the next row */
+        for (c = MAX(xres - 1 - half, 0); c < xres; c++) {
+            REMOVE_COLUMN(c);
+        }
+        below = 0;
+    }
+
+#undef ADD_COLUMN
+#undef REMOVE_COLUMN
+
+    g_free(hist);
+}
+
+/**
+ * filter_median:
+ * @dfield: A data field.
+ * @size: Side of the square window in pixels.
+ *
+ * Replaces each value with the median of its neighbourhood. The values
+ * are quantized to 16 bits of the data range, which is below what any
+ * exported image can show.
+ */
+void
+filter_median(GwyDataField *dfield, gint size)
+{
+    MedianData md;
+    guint16 *levels;
+    const gdouble *d;
+    gdouble max, *result;
+    gint i, n;
+
+    g_return_if_fail(size > 0);
+
+    md.xres = gwy_data_field_get_xres(dfield);
+    md.yres = gwy_data_field_get_yres(dfield);
+    md.size = size;
+    gwy_data_field_get_min_max(dfield, &md.min, &max);
+    if (max <= md.min || size == 1)
+        return;
+
+    md.step = (max - md.min)/(MEDIAN_LEVELS - 1);
+    n = md.xres*md.yres;
+    d = gwy_data_field_get_data_const(dfield);
+    levels = g_new(guint16, n);
+    for (i = 0; i < n; i++)
+        levels[i] = (guint16)((d[i] - md.min)/md.step + 0.5);
+
+    result = g_new(gdouble, n);
+    md.levels = levels;
+    md.dest = result;
+    run_row_blocks(median_rows, &md, md.yres);
+
+    memcpy(gwy_data_field_get_data(dfield), result, n*sizeof(gdouble));
+    g_free(result);
+    g_free(levels);
+    gwy_data_field_invalidate(dfield);
+    gwy_data_field_data_changed(dfield);
+}
+
+/* Multiplies the raw (not centred) spectrum by the filter response */
+static void
+highpass_rows(gpointer user_data, gint from, gint to)
+{
+    HighpassData *hd = (HighpassData*)user_data;
+    gdouble kx, ky, rho2, h, c2 = 2.0*hd->cutoff*hd->cutoff;
+    gint i, j, k;
+
+    for (i = from; i < to; i++) {
+        ky = (i <= hd->yres/2 ? i : i - hd->yres)/(0.5*hd->yres);
+        for (j = 0; j < hd->cols; j++) {
+            kx = (j <= hd->xres/2 ? j : j - hd->xres)/(0.5*hd->xres);
+            rho2 = kx*kx + ky*ky;
+            h = hd->norm*(1.0 - exp(-rho2/c2));
+            k = hd->step*(i*hd->cols + j);
+            hd->re[k] *= h;
+            hd->im[k] *= h;
+        }
+    }
+}
+
+#ifdef HAVE_FFTW3
+static void
+highpass_plans_clear(void)
+{
+    gint i;
+
+    for (i = 0; i < n_highpass_plans; i++) {
+        fftw_destroy_plan(highpass_plans[i].forward);
+        fftw_destroy_plan(highpass_plans[i].backward);
+    }
+    n_highpass_plans = 0;
+}
+
+/* The real transforms of a size, planned on the first call with the
+   buffers, which FFTW overwrites while measuring. Called with
+   highpass_lock held. */
+static const HighpassPlan*
+highpass_plan(gint xres, gint yres, gdouble *data, fftw_complex *spectrum)
+{
+    HighpassPlan *plan;
+    gint i;
+
+    for (i = 0; i < n_highpass_plans; i++) {
+        if (highpass_plans[i].xres == xres && highpass_plans[i].yres == yres)
+            return highpass_plans + i;
+    }
+    if (n_highpass_plans == HIGHPASS_PLANS)
+        highpass_plans_clear();
+
+    plan = highpass_plans + n_highpass_plans++;
+    plan->xres = xres;
+    plan->yres = yres;
+    plan->forward = fftw_plan_dft_r2c_2d(yres, xres, data, spectrum,
+                                         FFTW_MEASURE);
+    plan->backward = fftw_plan_dft_c2r_2d(yres, xres, spectrum, data,
+                                          FFTW_MEASURE);
+    return plan;
+}
+#endif
+
+/**
+ * filter_highpass:
+ * @dfield: A data field.
+ * @cutoff: Cut-off frequency as a fraction of the Nyquist frequency.
+ *
+ * Removes the low spatial frequencies with a Gaussian high-pass in the
+ * Fourier space. With FFTW the transforms are real to complex and
+ * back, planned once per size and kept for the next data field of
+ * that size. Without, the complex FFT of Gwyddion is used, which plans
+ * on every call.
+ */
+void
+filter_highpass(GwyDataField *dfield, gdouble cutoff)
+{
+    HighpassData hd;
+#ifdef HAVE_FFTW3
+    const HighpassPlan *plan;
+    fftw_complex *spectrum;
+    gdouble *data;
+    gsize n;
+#else
+    GwyDataField *re, *im, *iout;
+#endif
+
+    g_return_if_fail(cutoff > 0.0);
+
+    hd.xres = gwy_data_field_get_xres(dfield);
+    hd.yres = gwy_data_field_get_yres(dfield);
+    hd.cutoff = cutoff;
+
+#ifdef HAVE_FFTW3
+    n = (gsize)hd.xres*hd.yres;
+    data = fftw_malloc(n*sizeof(gdouble));
+    spectrum = fftw_malloc((gsize)hd.yres*(hd.xres/2 + 1)
+                           *sizeof(fftw_complex));
+
+    g_mutex_lock(&highpass_lock);
+    plan = highpass_plan(hd.xres, hd.yres, data, spectrum);
+    memcpy(data, gwy_data_field_get_data_const(dfield), n*sizeof(gdouble));
+    fftw_execute_dft_r2c(plan->forward, data, spectrum);
+
+    /* Only the non-negative x frequencies are stored */
+    hd.cols = hd.xres/2 + 1;
+    hd.step = 2;
+    hd.re = (gdouble*)spectrum;
+    hd.im = hd.re + 1;
+    hd.norm = 1.0/n;
+    run_row_blocks(highpass_rows, &hd, hd.yres);
+
+    fftw_execute_dft_c2r(plan->backward, spectrum, data);
+    g_mutex_unlock(&highpass_lock);
+    memcpy(gwy_data_field_get_data(dfield), data, n*sizeof(gdouble));
+    fftw_free(spectrum);
+    fftw_free(data);
+#else
+    re = gwy_data_field_new_alike(dfield, FALSE);
+    im = gwy_data_field_new_alike(dfield, FALSE);
+    iout = gwy_data_field_new_alike(dfield, FALSE);
+    gwy_data_field_2dfft_raw(dfield, NULL, re, im,
+                             GWY_TRANSFORM_DIRECTION_FORWARD);
+
+    /* The transforms of Gwyddion are normalized both ways */
+    hd.cols = hd.xres;
+    hd.step = 1;
+    hd.re = gwy_data_field_get_data(re);
+    hd.im = gwy_data_field_get_data(im);
+    hd.norm = 1.0;
+    run_row_blocks(highpass_rows, &hd, hd.yres);
+
+    gwy_data_field_2dfft_raw(re, im, dfield, iout,
+                             GWY_TRANSFORM_DIRECTION_BACKWARD);
+
+    g_object_unref(iout);
+    g_object_unref(im);
+    g_object_unref(re);
+#endif
+    gwy_data_field_invalidate(dfield);
+    gwy_data_field_data_changed(dfield);
+}
+
+/**
+ * filter_free_plans:
+ *
+ * Releases the FFT plans kept by filter_highpass(), if any.
+ */
+void
+filter_free_plans(void)
+{
+#ifdef HAVE_FFTW3
+    g_mutex_lock(&highpass_lock);
+    highpass_plans_clear();
+    g_mutex_unlock(&highpass_lock);
+#endif
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -0,0 +1,34 @@
+/*
+ *  filters.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Built-in data field filters of gwyexport which run in place and
+ *  split the work across rows on all processors
+ *
+ */
+
+#ifndef __GWYEXPORT_FILTERS_H__
+#define __GWYEXPORT_FILTERS_H__
+
+#include <libprocess/gwyprocess.h>
+
+/* Work on rows [from, to), or any other independent items */
+typedef void (*RowBlockFunc)(gpointer user_data, gint from, gint to);
+
+void run_row_blocks   (RowBlockFunc func,
+                       gpointer user_data,
+                       gint nrows);
+void filter_gaussian  (GwyDataField *dfield,
+                       gdouble sigma);
+void filter_median    (GwyDataField *dfield,
+                       gint size);
+void filter_highpass  (GwyDataField *dfield,
+                       gdouble cutoff);
+void filter_free_plans(void);
+
+#endif /* __GWYEXPORT_FILTERS_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -0,0 +1,161 @@
+/*
+ *  graph.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Export of graph curves as CSV or compact binary
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <libgwyddion/gwyddion.h>
+#include <libgwydgets/gwydgets.h>
+
+#include "graph.h"
+
+/* Plain text of a unit property of the graph model */
+static gchar*
+graph_unit(GwyGraphModel *gmodel, const gchar *property)
+{
+    GwySIUnit *unit = NULL;
+    gchar *s;
+
+    g_object_get(gmodel, property, &unit, NULL);
+    if (!unit)
+        return g_strdup("");
+    s = gwy_si_unit_get_string(unit, GWY_SI_UNIT_FORMAT_PLAIN);
+    g_object_unref(unit);
+    return s;
+}
+
+static gchar*
+curve_description(GwyGraphCurveModel *cmodel)
+{
+    gchar *s = NULL;
+
+    g_object_get(cmodel, "description", &s, NULL);
+    return s ? s : g_strdup("");
+}
+
+/**
+ * graph_to_csv:
+ * @gmodel: A graph model.
+ * @size: Location to store the length of the text.
+ *
+ * Writes the curves one after another as `x,y' lines, each preceded by
+ * a comment line with its description and separated by an empty line.
+ *
+ * Returns: A newly allocated text.
+ */
+gchar*
+graph_to_csv(GwyGraphModel *gmodel, gsize *size)
+{
+    GwyGraphCurveModel *cmodel;
+    const gdouble *xdata, *ydata;
+    GString *text;
+    gchar *title = NULL, *xunit, *yunit, *s;
+    gchar x[G_ASCII_DTOSTR_BUF_SIZE], y[G_ASCII_DTOSTR_BUF_SIZE];
+    gint i, j, n;
+
+    g_object_get(gmodel, "title", &title, NULL);
+    xunit = graph_unit(gmodel, "si-unit-x");
+    yunit = graph_unit(gmodel, "si-unit-y");
+    text = g_string_new(NULL);
+    g_string_append_printf(text, "# %s\n# x [%s], y [%s]\n",
+                           title ? title : "", xunit, yunit);
+    g_free(title);
+    g_free(xunit);
+    g_free(yunit);
+
+    for (i = 0; i < gwy_graph_model_get_n_curves(gmodel); i++) {
+        cmodel = gwy_graph_model_get_curve(gmodel, i);
+        n = gwy_graph_curve_model_get_ndata(cmodel);
+        xdata = gwy_graph_curve_model_get_xdata(cmodel);
+        ydata = gwy_graph_curve_model_get_ydata(cmodel);
+        s = curve_description(cmodel);
+        g_string_append_printf(text, "\n# curve %i: %s\n", i, s);
+        g_free(s);
+        for (j = 0; j < n; j++) {
+            g_string_append_printf(text, "%s,%s\n",
+                                   g_ascii_formatd(x, sizeof(x), "%.8g",
+                                                   xdata[j]),
+                                   g_ascii_formatd(y, sizeof(y), "%.8g",
+                                                   ydata[j]));
+        }
+    }
+
+    *size = text->len;
+    return g_string_free(text, FALSE);
+}
+
+static void
+append_le32(GString *buf, guint32 v)
+{
+    v = GUINT32_TO_LE(v);
+    g_string_append_len(buf, (const gchar*)&v, 4);
+}
+
+static void
+append_doubles(GString *buf, const gdouble *data, gint n)
+{
+    union { gdouble d; guint64 i; } v;
+    gint j;
+
+    for (j = 0; j < n; j++) {
+        v.d = data[j];
+        v.i = GUINT64_TO_LE(v.i);
+        g_string_append_len(buf, (const gchar*)&v, 8);
+    }
+}
+
+/**
+ * graph_to_binary:
+ * @gmodel: A graph model.
+ * @size: Location to store the length of the data.
+ *
+ * Writes the curves as
+ *
+ *   "GWXG" | number of curves (u32 LE)
+ *
+ * followed for each curve by
+ *
+ *   number of points (u32 LE) | description length (u32 LE)
+ *   | description | x (f64 LE) | y (f64 LE)
+ *
+ * Returns: A newly allocated buffer.
+ */
+gchar*
+graph_to_binary(GwyGraphModel *gmodel, gsize *size)
+{
+    GwyGraphCurveModel *cmodel;
+    GString *buf;
+    gchar *s;
+    gint i, n, ncurves;
+
+    ncurves = gwy_graph_model_get_n_curves(gmodel);
+    buf = g_string_new(NULL);
+    g_string_append_len(buf, GRAPH_MAGIC, 4);
+    append_le32(buf, ncurves);
+
+    for (i = 0; i < ncurves; i++) {
+        cmodel = gwy_graph_model_get_curve(gmodel, i);
+        n = gwy_graph_curve_model_get_ndata(cmodel);
+        s = curve_description(cmodel);
+        append_le32(buf, n);
+        append_le32(buf, strlen(s));
+        g_string_append(buf, s);
+        g_free(s);
+        append_doubles(buf, gwy_graph_curve_model_get_xdata(cmodel), n);
+        append_doubles(buf, gwy_graph_curve_model_get_ydata(cmodel), n);
+    }
+
+    *size = buf->len;
+    return g_string_free(buf, FALSE);
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
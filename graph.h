@@ -0,0 +1,27 @@
+/*
+ *  graph.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Export of graph curves as CSV or compact binary
+ *
+ */
+
+#ifndef __GWYEXPORT_GRAPH_H__
+#define __GWYEXPORT_GRAPH_H__
+
+#include <libgwydgets/gwydgets.h>
+
+/* Magic starting the binary curves */
+#define GRAPH_MAGIC "GWXG"
+
+gchar* graph_to_csv    (GwyGraphModel *gmodel,
+                        gsize *size);
+gchar* graph_to_binary (GwyGraphModel *gmodel,
+                        gsize *size);
+
+#endif /* __GWYEXPORT_GRAPH_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
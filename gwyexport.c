@@ -19,9 +19,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 #include <glib/gprintf.h>
+#include <glib/gstdio.h>
 
 #include <libgwymodule/gwymodule.h>
 #include <libgwymodule/gwymoduleenums.h>
@@ -38,25 +40,30 @@
 #include <libgwyddion/gwymd5.h>
 
 #include <config.h>
+#include "gwyexport.h"
+#include "private.h"
 
 #ifdef __unix__
       #include <unistd.h>
+      #include <fcntl.h>
+      #include <errno.h>
+      #include <signal.h>
+      #include <sys/wait.h>
+      #include <sys/resource.h>
       #define GC_SLEEP(t) usleep(t)
+      #define GC_FSYNC(fp) fsync(fileno(fp))
 #elif __MSDOS__ || __WIN32__ || _MSC_VER
       #include <windows.h>
       #include <io.h>
+      #include <fcntl.h>
       #define GC_SLEEP(t) Sleep(t)
+      #define GC_FSYNC(fp) _commit(_fileno(fp))
 #else
       #error "Target system undefined. Quit."
 #endif
 
 #define PACKAGENAME "gwyexport"
 
-typedef enum{
-    JPEG,
-    PNG,
-} FileFormat;
-
 typedef enum {
     EXPORT_RUNMODE_HELP=1,
     EXPORT_RUNMODE_VERSION,
@@ -64,113 +71,97 @@ typedef enum {
     EXPORT_RUNMODE_ERROR,
 } ExportModes;
 
-typedef enum {
-    CMAP_AUTO,
-    CMAP_ADAPTIVE,
-    CMAP_FULL,
-} ExportGlobals;
+/* Journal of completed files kept in the output directory */
+#define EXPORT_JOURNAL_NAME ".gwyexport-journal"
+/* Suffix of files being written, renamed when complete */
+#define EXPORT_PARTIAL_SUFFIX ".part"
+/* Marks a journal line of a file which failed, it is not skipped */
+#define EXPORT_JOURNAL_FAILED "!failed: "
+
+/* Output path streaming framed outputs to stdout */
+#define EXPORT_STREAM_PATH "-"
+/* Magic starting each frame of the stdout stream */
+#define STREAM_MAGIC "GWXF"
 
-#define EXPORT_DEFAULT_FILTERLIST "pc;melc;sr;melc;pc"
-#define EXPORT_FILTER_DELIMITER ";"
+/* Tar archives are written in blocks of this size */
+#define TAR_BLOCKSIZE 512
 
 typedef struct {
     /* GwyExport Instance data */
     gchar* inputfile;
     gchar* outpath;
-    FileFormat format;
-    gchar* filterlist;
-    gchar* gradient;
     ExportModes runmode;
-    gboolean printmetafile;
     gboolean silentmode;
-    ExportGlobals colormapping;
+    ExportOptions options;
+    ExportContext *context;
     GPtrArray *filelist;
-
-    gint *channel_ids;
-    gint n_channels;
+    gchar* archivepath;
+    FILE* archive;
+    gboolean stream;
+    gboolean resume;
+    FILE* journal;
+    GHashTable *done;
+    GString *outputs;
+    gboolean complete;
+    gboolean isolate;
+    gint timeout;
+    gint memlimit;
+    GPtrArray *failed;
+    gboolean global_range;
+    /* Sources and caches of the survey, in pairs */
+    GPtrArray *cached;
+    /* The cache directory was created for this run */
+    gboolean remove_cache;
+    gboolean benchmark;
+    gdouble bench_time[N_FORMATS];
+    guint64 bench_size[N_FORMATS];
 } ExportGlobalParameters;
 
 
-typedef struct {
-    /* Abstract image data */
-    gchar* ident;
-    gchar* cycle_ident;
-    gchar* title;
-    gchar* filename;
-    gchar* metafilename;
-    gchar* date;
-    gchar* scalebar_text;
-    gdouble scalebar_relwidth;
-    gchar* processing;
-
-    /* Numerical values from image */
-    gdouble colormin;
-    gdouble colormax;
-
-} ExportImageParameters;
-
-/* String length for metadata keys */
-#define STRN 100
-
-#define GC_MESSAGE(gp, s, ...) \
-    if (!gp->silentmode) { \
-        g_message(s, ##__VA_ARGS__); \
-    }
-#define GC_WARNING(gp, s, ...) \
-    if (!gp->silentmode) { \
-        g_warning(s, ##__VA_ARGS__); \
-    }
-#define STR_APPEND(s, a, t) \
-    if ( !s ) s = g_strdup(a); \
-    else { \
-        t = g_strconcat(s, g_strdup(", "), a, NULL); \
-        g_free(s); \
-        s = t; \
-    } \
-
-static void     handle_single_channel  (ExportGlobalParameters *gp,
-                                        gint channelid);
+static gboolean handle_single_file     (ExportGlobalParameters *gp,
+                                        gchar *filename);
+static void     run_single_file        (ExportGlobalParameters *gp,
+                                        gchar *filename);
+static void     survey_single_file     (ExportGlobalParameters *gp,
+                                        gchar *filename);
+static void     export_cached_files    (ExportGlobalParameters *gp);
+static void     benchmark_formats      (ExportGlobalParameters *gp,
+                                        GdkPixbuf *pixbuf);
+static void     print_benchmark        (ExportGlobalParameters *gp);
 static void     print_help             (void);
-static void     init_gwyddion          (void);
-static gboolean run_filters            (GwyContainer *datacont,
-                                        GwyContainer *settings,
-                                        ExportGlobalParameters *gp,
-                                        ExportImageParameters *ip);
 static void     process_args           (int argc, char* argv[],
                                         ExportGlobalParameters *gp);
-static gboolean execute_process_module (gchar *procname,
-                                        GwyContainer *data);
 static ExportGlobalParameters* glob_params_new();
-static ExportImageParameters*  img_params_new();
-static gchar* scalebar_auto_length     (gdouble real,
-                                        GwySIUnit *siunit,
-                                        gdouble *p);
-double pow10 ( double x );
-
-/* The data file contents */
-static GwyContainer *data;
-/* And the Gwyddion settings */
-static GwyContainer *settings;
-
-
-/* Initialize gwyddion */
-static void init_gwyddion(void)
-{
-    gwy_app_init_common(NULL, "layer", "file", "process", NULL);
-    settings = gwy_app_settings_get();
-
-    /* Disable undo function to save memory */
-    gwy_undo_set_enabled(FALSE);
-    gwy_app_data_browser_set_gui_enabled(FALSE);
-}
-
-
+static gboolean uses_stdout            (ExportGlobalParameters *gp);
+static void     set_stdout_binary      (void);
+static gboolean archive_open           (ExportGlobalParameters *gp);
+static gboolean archive_add_entry      (ExportGlobalParameters *gp,
+                                        const gchar *name,
+                                        const ExportOutput *out);
+static void     archive_close          (ExportGlobalParameters *gp);
+static gboolean journal_open           (ExportGlobalParameters *gp);
+static gboolean journal_is_done        (ExportGlobalParameters *gp,
+                                        const gchar *filename);
+static void     journal_add            (ExportGlobalParameters *gp);
+static void     journal_fail           (ExportGlobalParameters *gp,
+                                        const gchar *filename,
+                                        const gchar *reason);
+static void     record_failure         (ExportGlobalParameters *gp,
+                                        const gchar *filename,
+                                        const gchar *reason);
+static void     journal_close          (ExportGlobalParameters *gp);
+static gchar*   journal_key            (const gchar *filename);
+static gboolean sync_directory         (const gchar *path);
+static gboolean write_output           (ExportGlobalParameters *gp,
+                                        const ExportOutput *out,
+                                        const gchar *filename);
 /* Parses the command line arguments. */
 static void
 process_args(int argc, char* argv[], ExportGlobalParameters* gp)
 {
     gint i=1;
     gint j=0;
+    FileFormat format;
 
     while (i < argc) {
         if (gwy_strequal(argv[i], "--help") ||
@@ -194,31 +185,29 @@ process_args(int argc, char* argv[], ExportGlobalParameters* gp)
         }
         else if (gwy_strequal(argv[i], "--metadata") ||
                  gwy_strequal(argv[i], "-m")) {
-            gp->printmetafile = TRUE;
+            gp->options.metadata = TRUE;
         }
         else if (gwy_strequal(argv[i], "--filters") ||
                  gwy_strequal(argv[i], "-fl")) {
             // Filter list if complete
             if( i+1 < argc) {
-                gp->filterlist = g_strdup(argv[++i]);
+                gp->options.filterlist = g_strdup(argv[++i]);
             } else {
                 GC_WARNING(gp, "No filter list defined, will use default list.\n");
-                gp->filterlist = g_strdup(EXPORT_DEFAULT_FILTERLIST);
+                gp->options.filterlist = g_strdup(EXPORT_DEFAULT_FILTERLIST);
             }
         }
         else if (gwy_strequal(argv[i], "--defaultfilters")) {
             // Default filters are used
-            gp->filterlist = g_strdup(EXPORT_DEFAULT_FILTERLIST);
+            gp->options.filterlist = g_strdup(EXPORT_DEFAULT_FILTERLIST);
         }
         else if (gwy_strequal(argv[i], "--format") ||
                  gwy_strequal(argv[i], "-f")) {
             if(i+1<argc){
                 ++i;
-                if (gwy_strequal(argv[i], "png")) {
-                    gp->format = PNG;
-                }
-                else if (gwy_strequal(argv[i], "jpg")) {
-                    gp->format = JPEG;
+                format = encode_format_from_name(argv[i]);
+                if (encode_format_available(format)) {
+                    gp->options.format = format;
                 }
                 else{
                     GC_WARNING(gp, "Unknow file format\n");
@@ -232,7 +221,7 @@ process_args(int argc, char* argv[], ExportGlobalParameters* gp)
                  gwy_strequal(argv[i], "-g")) {
             // Color gradient if complete
             if(i+1 < argc) {
-                gp->gradient = g_strdup(argv[++i]);
+                gp->options.gradient = g_strdup(argv[++i]);
             } else {
                 GC_WARNING(gp, "No gradient defined\n");
             }
@@ -243,18 +232,140 @@ process_args(int argc, char* argv[], ExportGlobalParameters* gp)
             if ( i+1 < argc ) {
                 ++i;
                 if (gwy_strequal(argv[i], "auto") ) {
-                    gp->colormapping = CMAP_AUTO;
+                    gp->options.colormapping = CMAP_AUTO;
                 } else if (gwy_strequal(argv[i], "full") ) {
-                    gp->colormapping = CMAP_FULL;
+                    gp->options.colormapping = CMAP_FULL;
                 } else if (gwy_strequal(argv[i], "adaptive") ) {
-                    gp->colormapping = CMAP_ADAPTIVE;
+                    gp->options.colormapping = CMAP_ADAPTIVE;
+                } else if (gwy_strequal(argv[i], "equalize") ) {
+                    gp->options.colormapping = CMAP_EQUALIZE;
+                } else if (g_str_has_prefix(argv[i], "clip:") &&
+                           sscanf(argv[i] + 5, "%lf,%lf", &gp->options.clip_low,
+                                  &gp->options.clip_high) == 2 &&
+                           0.0 <= gp->options.clip_low &&
+                           gp->options.clip_low < gp->options.clip_high &&
+                           gp->options.clip_high <= 100.0) {
+                    gp->options.colormapping = CMAP_CLIP;
                 } else {
                     GC_WARNING(gp, "Unknown colormapping `%s'. "
                                    "Using `adaptive'.", argv[i]);
-                    gp->colormapping = CMAP_ADAPTIVE;
+                    gp->options.colormapping = CMAP_ADAPTIVE;
+                }
+            }
+        }
+        else if (gwy_strequal(argv[i], "--archive") ||
+                 gwy_strequal(argv[i], "-a")) {
+            // Tar archive instead of single files, `-' is stdout
+            if ( i+1 < argc ) {
+                gp->archivepath = g_strdup(argv[++i]);
+            } else {
+                GC_WARNING(gp, "No archive defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--resume") ||
+                 gwy_strequal(argv[i], "-r")) {
+            gp->resume = TRUE;
+        }
+        else if (gwy_strequal(argv[i], "--max-size")) {
+            // Largest image side in pixels, larger data are downsampled
+            if ( i+1 < argc ) {
+                gp->options.maxsize = atoi(argv[++i]);
+                if (gp->options.maxsize <= 0) {
+                    GC_WARNING(gp, "Maximum size must be positive, "
+                                   "ignoring `--max-size'.");
+                    gp->options.maxsize = 0;
+                }
+            } else {
+                GC_WARNING(gp, "No maximum size defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--scale")) {
+            // Downsampling factor
+            if ( i+1 < argc ) {
+                gp->options.scale = g_ascii_strtod(argv[++i], NULL);
+                if (!(gp->options.scale > 0.0 && gp->options.scale <= 1.0)) {
+                    GC_WARNING(gp, "Scale must be within (0, 1], images are "
+                                   "only downsampled. Ignoring `--scale'.");
+                    gp->options.scale = 0.0;
+                }
+            } else {
+                GC_WARNING(gp, "No scale defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--isolate") ||
+                 gwy_strequal(argv[i], "-i")) {
+            gp->isolate = TRUE;
+        }
+        else if (gwy_strequal(argv[i], "--timeout")) {
+            // Wall-clock limit in seconds for an isolated file
+            if ( i+1 < argc ) {
+                gp->timeout = atoi(argv[++i]);
+            } else {
+                GC_WARNING(gp, "No timeout defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--memlimit")) {
+            // Address space limit in MB for an isolated file
+            if ( i+1 < argc ) {
+                gp->memlimit = atoi(argv[++i]);
+            } else {
+                GC_WARNING(gp, "No memory limit defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--volumes")) {
+            // Export of volume data
+            if ( i+1 < argc ) {
+                ++i;
+                if (gwy_strequal(argv[i], "images")) {
+                    gp->options.volumes = EXPORT_VOLUME_IMAGES;
+                } else if (gwy_strequal(argv[i], "raw")) {
+                    gp->options.volumes = EXPORT_VOLUME_RAW;
+                } else {
+                    GC_WARNING(gp, "Unknown volume export `%s'. "
+                                   "Ignoring.", argv[i]);
                 }
+            } else {
+                GC_WARNING(gp, "No volume export defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--graphs")) {
+            // Export of graph curves
+            if ( i+1 < argc ) {
+                ++i;
+                if (gwy_strequal(argv[i], "csv")) {
+                    gp->options.graphs = EXPORT_GRAPH_CSV;
+                } else if (gwy_strequal(argv[i], "bin")) {
+                    gp->options.graphs = EXPORT_GRAPH_BINARY;
+                } else {
+                    GC_WARNING(gp, "Unknown graph export `%s'. "
+                                   "Ignoring.", argv[i]);
+                }
+            } else {
+                GC_WARNING(gp, "No graph export defined\n");
             }
         }
+        else if (gwy_strequal(argv[i], "--global-range")) {
+            gp->global_range = TRUE;
+        }
+        else if (gwy_strequal(argv[i], "--cache")) {
+            // Directory of the processed data between both passes
+            if ( i+1 < argc ) {
+                gp->options.cache_dir = g_strdup(argv[++i]);
+            } else {
+                GC_WARNING(gp, "No cache directory defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--bands")) {
+            // Rows rendered and encoded at once
+            if ( i+1 < argc ) {
+                gp->options.band_rows = atoi(argv[++i]);
+            } else {
+                GC_WARNING(gp, "No band height defined\n");
+            }
+        }
+        else if (gwy_strequal(argv[i], "--benchmark")) {
+            gp->benchmark = TRUE;
+        }
         else if (gwy_strequal(argv[i], "--silentmode") ||
                  gwy_strequal(argv[i], "-s")) {
             gp->silentmode = TRUE;
@@ -277,24 +388,97 @@ process_args(int argc, char* argv[], ExportGlobalParameters* gp)
         gp->runmode = EXPORT_RUNMODE_HELP;
         return;
     }
+    if(gp->outpath && gwy_strequal(gp->outpath, EXPORT_STREAM_PATH)) {
+        // Framed outputs on stdout, paths are only used as names
+        g_free(gp->outpath);
+        gp->outpath = NULL;
+        if (gp->archivepath) {
+            GC_WARNING(gp, "Cannot stream and write an archive at once, "
+                           "ignoring `--output %s'.", EXPORT_STREAM_PATH);
+        } else {
+            gp->stream = TRUE;
+            gp->outpath = g_strdup("");
+        }
+    }
+    if(!gp->outpath && gp->archivepath) {
+        // Everything goes to the archive, paths are only used as names
+        gp->outpath = g_strdup("");
+    }
     if(!gp->outpath || gp->outpath == NULL) {
         // outpath undefined. Use the current directory
         gp->outpath = g_get_current_dir();
         GC_WARNING(gp, "No output path defined. Using directory:\n%s",
                    gp->outpath);
     }
-    if(!gp->gradient || gp->gradient == NULL) {
-        gp->gradient = "ReiGreen";
+    if(!gp->options.gradient || gp->options.gradient == NULL) {
+        gp->options.gradient = "ReiGreen";
         GC_WARNING(gp, "No Gradient given. Using `ReiGreen' or default.");
     }
-    if((!gp->colormapping) || (gp->colormapping <= 0)) {
-        gp->colormapping = CMAP_AUTO;
+    if(gp->resume && (gp->archivepath || gp->stream)) {
+        gp->resume = FALSE;
+        GC_WARNING(gp, "An archive or stream is always written from "
+                       "scratch, ignoring `--resume'.");
+    }
+    if((gp->timeout > 0 || gp->memlimit > 0) && !gp->isolate) {
+        gp->isolate = TRUE;
+        GC_WARNING(gp, "Limits given, running files isolated.");
+    }
+    if(gp->isolate && (gp->archivepath || gp->stream)) {
+        /* A killed child would leave a truncated entry or frame */
+        gp->isolate = FALSE;
+        GC_WARNING(gp, "Files cannot be isolated when writing an "
+                       "archive or stream, ignoring `--isolate'.");
+    }
+#ifndef __unix__
+    if(gp->isolate) {
+        gp->isolate = FALSE;
+        GC_WARNING(gp, "Isolation is not supported on this system.");
+    }
+#endif
+    if((!gp->options.colormapping) || (gp->options.colormapping <= 0)) {
+        gp->options.colormapping = CMAP_AUTO;
         GC_WARNING(gp, "No Colormapping defined. Using `AUTO'.");
     }
-    if(!gp->filterlist || gp->filterlist == NULL) {
-        gp->filterlist = g_strdup(EXPORT_DEFAULT_FILTERLIST);
+    if(!gp->options.filterlist || gp->options.filterlist == NULL) {
+        gp->options.filterlist = g_strdup(EXPORT_DEFAULT_FILTERLIST);
         GC_WARNING(gp, "No filters defined. Using defaults.");
     }
+    if(gp->options.cache_dir && !gp->global_range) {
+        GC_WARNING(gp, "The cache is only used by `--global-range', "
+                       "ignoring `--cache'.");
+    }
+    if(gp->global_range && gp->resume) {
+        /* The ranges need every file */
+        gp->resume = FALSE;
+        GC_WARNING(gp, "The global range needs all files, ignoring "
+                       "`--resume'.");
+    }
+    if(gp->global_range && gp->isolate) {
+        /* The ranges are collected in this process */
+        gp->isolate = FALSE;
+        GC_WARNING(gp, "Files cannot be isolated with a global range, "
+                       "ignoring `--isolate'.");
+    }
+    if(gp->options.band_rows < 0) {
+        gp->options.band_rows = 0;
+        GC_WARNING(gp, "Band height must be positive, ignoring `--bands'.");
+    }
+    if(gp->options.band_rows > 0
+       && !encode_rows_available(gp->options.format)) {
+        gp->options.band_rows = 0;
+        GC_WARNING(gp, "Bands are only available for png and jpg in this "
+                       "build, rendering whole images.");
+    }
+    if(gp->options.band_rows > 0 && !gp->global_range
+       && gp->options.colormapping == CMAP_ADAPTIVE) {
+        GC_WARNING(gp, "The adaptive colormap needs whole images, channels "
+                       "are not rendered in bands.");
+    }
+    if(gp->options.band_rows > 0 && gp->benchmark) {
+        gp->options.band_rows = 0;
+        GC_WARNING(gp, "The benchmark needs whole images, ignoring "
+                       "`--bands'.");
+    }
 
     return;
 }
@@ -307,61 +491,370 @@ static ExportGlobalParameters* glob_params_new() {
     *gp = null;
 
     gp->silentmode = FALSE;
+    export_options_init(&gp->options);
     gp->filelist = g_ptr_array_new();
+    gp->outputs = g_string_new(NULL);
+    gp->failed = g_ptr_array_new();
     return gp;
 }
 
-static ExportImageParameters* img_params_new() {
-    ExportImageParameters *ip=NULL;
-    ExportImageParameters null = {0};
+/* Wraps a buffer of a channel as an output */
+static ExportOutput
+channel_output(ExportChannelResult *ch, const gchar *kind,
+               gchar *buffer, gsize size)
+{
+    ExportOutput out = {0};
+
+    out.id = ch->id;
+    out.level = ch->level;
+    out.title = ch->title;
+    out.name = ch->name;
+    out.kind = kind;
+    out.buffer = buffer;
+    out.size = size;
+    return out;
+}
+
+/* Writes the image and metadata of a channel or volume level */
+static void write_channel(ExportGlobalParameters* gp, ExportChannelResult *ch)
+{
+    ExportOutput out;
+    gchar *basepath, *path;
 
-    ip = g_new(ExportImageParameters, 1);
-    *ip = null;
+    if (gp->benchmark && ch->pixbuf) {
+        benchmark_formats(gp, ch->pixbuf);
+    }
 
-    return ip;
+    /* Archive entries and stream frames need the size first, so bands
+       are encoded in memory for them and straight to files otherwise */
+    if ((gp->archive || gp->stream) && !ch->image && ch->bands) {
+        export_channel_encode(ch);
+    }
+
+    basepath = g_build_filename(gp->outpath, ch->name, NULL);
+    path = g_strconcat(basepath,
+                       encode_format_extension(gp->options.format), NULL);
+    out = channel_output(ch, encode_format_name(gp->options.format),
+                         ch->image, ch->image_size);
+    if (!ch->image)
+        out.bands = ch->bands;
+    if (ch->error) {
+        GC_WARNING(gp, "%s", ch->error->message);
+        gp->complete = FALSE;
+    } else if (write_output(gp, &out, path)) {
+        GC_MESSAGE(gp, " => Saved to file `%s'", path);
+    } else {
+        GC_WARNING(gp, " Error file `%s' not saved", path);
+    }
+    g_free(path);
+    /* Images encoded from bands, in write_result() or above, are only
+       kept until written */
+    if (ch->bands && ch->image) {
+        g_free(ch->image);
+        ch->image = NULL;
+        ch->image_size = 0;
+    }
+
+    if (ch->metadata) {
+        path = g_strconcat(basepath, ".txt", NULL);
+        out = channel_output(ch, "txt", ch->metadata, ch->metadata_size);
+        if (!write_output(gp, &out, path)) {
+            GC_WARNING(gp, " Error file `%s' not saved", path);
+        }
+        g_free(path);
+    }
+    g_free(basepath);
+}
+
+/* Writes the images, metadata, volumes and graphs of a result to the
+   outputs and journals its file */
+static void write_result(ExportGlobalParameters* gp, ExportResult *result)
+{
+    gchar *path;
+    gint i, k, window;
+
+    for (i = 0; i < result->n_channels; ++i) {
+        write_channel(gp, result->channels + i);
+    }
+    /* Volume levels are rendered and encoded in parallel, one window of
+       as many levels as processors at a time */
+    window = MAX(g_get_num_processors(), 1);
+    for (i = 0; i < result->n_levels; i += window) {
+        export_levels_encode(result, i, window);
+        for (k = i; k < MIN(i + window, result->n_levels); ++k) {
+            write_channel(gp, result->levels + k);
+        }
+    }
+    for (i = 0; i < result->n_outputs; ++i) {
+        path = g_build_filename(gp->outpath, result->outputs[i].name, NULL);
+        if (write_output(gp, result->outputs + i, path)) {
+            GC_MESSAGE(gp, " => Saved to file `%s'", path);
+        } else {
+            GC_WARNING(gp, " Error file `%s' not saved", path);
+        }
+        g_free(path);
+    }
+    journal_add(gp);
 }
 
-static void handle_single_file(ExportGlobalParameters* gp, gchar* filename)
+/** Exports a file and writes its images, metadata, volumes and graphs
+ *  to the outputs. Returns FALSE if the file could not be loaded or
+ *  any of its outputs not written.
+ */
+static gboolean handle_single_file(ExportGlobalParameters* gp, gchar* filename)
 {
+    ExportResult result;
     GError *err = NULL;
-    gint i=0;
     gp->inputfile = filename;
 
-    /* Load the file */
-    data = gwy_file_load(filename, GWY_RUN_NONINTERACTIVE, &err);
-    if (!data) {
-        GC_WARNING(gp, "Cannot load `%s': %s\n",
-                   filename, err->message);
+    if (journal_is_done(gp, filename)) {
+        GC_MESSAGE(gp, "Already exported, skipping `%s'", filename);
+        return TRUE;
+    }
+    g_string_truncate(gp->outputs, 0);
+    gp->complete = TRUE;
+
+    if (!export_file(gp->context, filename, &gp->options, &result, &err)) {
+        GC_WARNING(gp, "%s\n", err->message);
         g_clear_error(&err);
+        return FALSE;
+    }
+
+    write_result(gp, &result);
+    export_result_clear(&result);
+    return gp->complete;
+}
+
+/** First pass of --global-range: processes a file into the ranges of
+ *  the batch and caches the processed data
+ */
+static void survey_single_file(ExportGlobalParameters* gp, gchar* filename)
+{
+    ExportResult result;
+    GError *err = NULL;
+
+    if (!export_file(gp->context, filename, &gp->options, &result, &err)) {
+        GC_WARNING(gp, "%s\n", err->message);
+        g_clear_error(&err);
+        record_failure(gp, filename, "not surveyed");
         return;
     }
+    g_ptr_array_add(gp->cached, g_strdup(filename));
+    g_ptr_array_add(gp->cached, g_strdup(result.cache));
+    export_result_clear(&result);
+}
+
+/** Second pass of --global-range: exports the cached files with the
+ *  ranges of the whole batch, removing each cache once done
+ */
+static void export_cached_files(ExportGlobalParameters* gp)
+{
+    ExportResult result;
+    GError *err = NULL;
+    gchar *filename, *cache;
+    guint i;
+
+    gp->options.survey = FALSE;
+    for (i = 0; i + 1 < gp->cached->len; i += 2) {
+        filename = (gchar*) g_ptr_array_index(gp->cached, i);
+        cache = (gchar*) g_ptr_array_index(gp->cached, i + 1);
+        GC_MESSAGE(gp, "===> Rendering file %s", filename);
+        gp->inputfile = filename;
+        g_string_truncate(gp->outputs, 0);
+        gp->complete = TRUE;
+
+        if (export_cache(gp->context, cache, filename, &gp->options,
+                         &result, &err)) {
+            write_result(gp, &result);
+            export_result_clear(&result);
+        } else {
+            GC_WARNING(gp, "%s\n", err->message);
+            g_clear_error(&err);
+            gp->complete = FALSE;
+        }
+        if (!gp->complete)
+            record_failure(gp, filename, "not exported");
+        g_remove(cache);
+    }
+}
 
-    /* Register data to the data browser to be able to use
-     * gwy_app_data_browser_get_data_ids() */
-    gwy_app_data_browser_add(data);
-    /* But do not let it manage our file */
-    gwy_app_data_browser_set_keep_invisible(data, TRUE);
-
-    /* Obtain the list of channel numbers and check whether
-       there are any */
-    gp->channel_ids = gwy_app_data_browser_get_data_ids(data);
-    for (gp->n_channels = 0;
-         gp->channel_ids[gp->n_channels] != -1; gp->n_channels++)
-        ;
-    if (gp->n_channels <= 0) {
-        GC_WARNING(gp, "File `%s' contains no channels to export\n",
+#ifdef __unix__
+/* Removes the partial outputs a killed child left for filename */
+static void
+remove_partial_outputs(ExportGlobalParameters* gp, const gchar* filename)
+{
+    GDir *dir;
+    const gchar *name;
+    gchar *basename, *prefix, *path;
+
+    dir = g_dir_open(gp->outpath, 0, NULL);
+    if (!dir)
+        return;
+    /* Outputs are named <source>-..., see export_channel() */
+    basename = g_path_get_basename(filename);
+    prefix = g_strconcat(basename, "-", NULL);
+    g_free(basename);
+    while ((name = g_dir_read_name(dir))) {
+        if (g_str_has_prefix(name, prefix)
+            && g_str_has_suffix(name, EXPORT_PARTIAL_SUFFIX)) {
+            path = g_build_filename(gp->outpath, name, NULL);
+            g_remove(path);
+            g_free(path);
+        }
+    }
+    g_free(prefix);
+    g_dir_close(dir);
+}
+
+/** Cuts the line left incomplete at the end of the journal by a child
+ *  killed while writing it, so the next line starts on its own. A
+ *  resume only ignores an incomplete last line.
+ */
+static void
+journal_repair(ExportGlobalParameters* gp)
+{
+    gchar *path, *contents = NULL;
+    gsize length, end;
+
+    if (!gp->journal)
+        return;
+
+    fflush(gp->journal);
+    path = g_build_filename(gp->outpath, EXPORT_JOURNAL_NAME, NULL);
+    if (g_file_get_contents(path, &contents, &length, NULL)) {
+        for (end = length; end > 0 && contents[end-1] != '\n'; --end)
+            ;
+        if (end < length
+            && (ftruncate(fileno(gp->journal), end) != 0
+                || fseek(gp->journal, end, SEEK_SET) != 0)) {
+            GC_WARNING(gp, "Cannot cut the incomplete line of journal `%s'",
+                       path);
+        }
+    }
+    g_free(contents);
+    g_free(path);
+}
+
+/* The size of the address space of this process in bytes, 0 where
+   /proc/self/statm is not available */
+static guint64
+address_space_size(void)
+{
+    gchar *text = NULL;
+    guint64 pages = 0;
+
+    if (g_file_get_contents("/proc/self/statm", &text, NULL, NULL))
+        pages = g_ascii_strtoull(text, NULL, 10);
+    g_free(text);
+    return pages*(guint64)sysconf(_SC_PAGESIZE);
+}
+
+/** Runs handle_single_file() in a child process limited to
+ *  gp->memlimit MB of address space on top of what it inherits from
+ *  the parent, and gp->timeout seconds, so a
+ *  file which hangs or crashes the loader or a module only fails
+ *  itself. The child exits with 1 if the file failed. Failures are
+ *  recorded with record_failure().
+ */
+static gboolean
+handle_single_file_isolated(ExportGlobalParameters* gp, gchar* filename)
+{
+    struct rlimit limit;
+    gint64 deadline;
+    gchar *reason;
+    pid_t pid, r;
+    int status = 0;
+
+    /* Do not let the child flush our buffers a second time */
+    fflush(NULL);
+    pid = fork();
+    if (pid < 0) {
+        GC_WARNING(gp, "Cannot fork, processing `%s' in process.",
                    filename);
+        if (!handle_single_file(gp, filename)) {
+            record_failure(gp, filename, "not exported");
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if (pid == 0) {
+        /* RLIMIT_AS also counts the libraries and modules mapped by
+           the parent, so the limit is added to them */
+        if (gp->memlimit > 0) {
+            limit.rlim_cur = limit.rlim_max
+                = (rlim_t)(address_space_size()
+                           + ((guint64)gp->memlimit << 20));
+            setrlimit(RLIMIT_AS, &limit);
+        }
+        status = handle_single_file(gp, filename) ? 0 : 1;
+        fflush(NULL);
+        _exit(status);
     }
 
-    /* Iterate all channels */
-    for (i = 0; i < gp->n_channels; ++i) {
-      handle_single_channel(gp, i);
+    deadline = g_get_monotonic_time() + (gint64)gp->timeout*G_USEC_PER_SEC;
+    while ((r = waitpid(pid, &status, WNOHANG)) == 0
+           || (r < 0 && errno == EINTR)) {
+        if (gp->timeout > 0 && g_get_monotonic_time() > deadline) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            GC_WARNING(gp, "`%s' timed out after %i s, killed.",
+                       filename, gp->timeout);
+            remove_partial_outputs(gp, filename);
+            journal_repair(gp);
+            reason = g_strdup_printf("timed out after %i s", gp->timeout);
+            record_failure(gp, filename, reason);
+            g_free(reason);
+            return FALSE;
+        }
+        GC_SLEEP(10000);
+    }
+    if (r < 0) {
+        GC_WARNING(gp, "Lost the process handling `%s'.", filename);
+        record_failure(gp, filename, "process lost");
+        return FALSE;
+    }
+    if (WIFSIGNALED(status)) {
+        GC_WARNING(gp, "`%s' crashed with signal %i.",
+                   filename, WTERMSIG(status));
+        remove_partial_outputs(gp, filename);
+        journal_repair(gp);
+        reason = g_strdup_printf("signal %i", WTERMSIG(status));
+        record_failure(gp, filename, reason);
+        g_free(reason);
+        return FALSE;
     }
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        GC_WARNING(gp, "`%s' failed with status %i.",
+                   filename, WEXITSTATUS(status));
+        reason = g_strdup_printf("exit status %i", WEXITSTATUS(status));
+        record_failure(gp, filename, reason);
+        g_free(reason);
+        return FALSE;
+    }
+    return TRUE;
+}
+#endif
 
-    gwy_app_data_browser_remove(data);
-    gwy_app_data_browser_shut_down();
-    g_object_unref(data);
-    g_free(err);
+/* Handles a file in process or isolated, depending on gp->isolate, or
+   surveys it for a global range */
+static void run_single_file(ExportGlobalParameters* gp, gchar* filename)
+{
+    if (gp->global_range) {
+        survey_single_file(gp, filename);
+        return;
+    }
+#ifdef __unix__
+    if (gp->isolate) {
+        if (journal_is_done(gp, filename)) {
+            GC_MESSAGE(gp, "Already exported, skipping `%s'", filename);
+        } else {
+            handle_single_file_isolated(gp, filename);
+        }
+        return;
+    }
+#endif
+    if (!handle_single_file(gp, filename))
+        record_failure(gp, filename, "not exported");
 }
 
 int
@@ -384,22 +877,60 @@ main(int argc, char *argv[])
     if (gp->runmode == EXPORT_RUNMODE_ERROR) {
         exit(1);
     }
-    if(!gp->silentmode) {
+    if(!gp->silentmode && !uses_stdout(gp)) {
       g_printf("==\nThis is %s v%s(2011) by François Bianco"
                    "(francois.bianco@unige.ch)\nBased on code by Philipp Rahe\n==\n", PACKAGENAME, VERSION);
     }
 
+    if (gp->archivepath && !archive_open(gp)) {
+        exit(1);
+    }
+    if (gp->stream) {
+        set_stdout_binary();
+    }
+    if (!gp->archivepath && !gp->stream && !journal_open(gp)) {
+        exit(1);
+    }
+
+    /* Initialize Gtk+ */
+    gtk_init(&argc, &argv);
+    g_set_application_name(PACKAGENAME);
+
+    /* Initialize Gwyddion stuff, once for the whole batch */
+    GError *err = NULL;
+    gp->options.silentmode = gp->silentmode;
+    gp->options.keep_pixbuf = gp->benchmark;
+    gp->context = export_context_new(&err);
+    if (!gp->context) {
+        g_warning("%s\n", err->message);
+        g_clear_error(&err);
+        exit(1);
+    }
+
+    /* The global range surveys all files first, keeping their processed
+       data in the cache until the second pass */
+    if (gp->global_range) {
+        gp->options.ranges = export_ranges_new();
+        gp->options.survey = TRUE;
+        gp->cached = g_ptr_array_new();
+        if (!gp->options.cache_dir) {
+            gp->options.cache_dir = g_dir_make_tmp(PACKAGENAME "-XXXXXX",
+                                                   &err);
+            if (!gp->options.cache_dir) {
+                g_warning("%s\n", err->message);
+                g_clear_error(&err);
+                exit(1);
+            }
+            gp->remove_cache = TRUE;
+        }
+    }
+
     gint i;
     const gchar* filename = NULL;
     const gchar* directory_path = NULL;
+    gchar* path = NULL;
+    gint ret = 0;
     for(i=0;i<gp->filelist->len;++i){
-         /* Initialize Gtk+ */
-        gtk_init(&argc, &argv);
-        g_set_application_name(PACKAGENAME);
-
-         /* Initialize Gwyddion stuff */
-        init_gwyddion();
-    
         filename = (gchar*) g_ptr_array_index(gp->filelist,i);
         if (g_file_test(filename, G_FILE_TEST_IS_DIR)) {
             directory_path = filename;
@@ -412,473 +943,518 @@ main(int argc, char *argv[])
             }
             while ((filename = g_dir_read_name(dir))){
                 GC_MESSAGE(gp, "===> Processing file %s", filename);
-                handle_single_file(gp, g_build_filename(directory_path,
-                                                        filename, NULL));
+                path = g_build_filename(directory_path, filename, NULL);
+                run_single_file(gp, path);
+                g_free(path);
             }
             g_dir_close(dir);
         }
         else if (g_file_test(filename, G_FILE_TEST_EXISTS)) {
             GC_MESSAGE(gp, "===> Processing file %s",
                        (gchar*) g_ptr_array_index(gp->filelist,i));
-            handle_single_file(gp, (gchar*) g_ptr_array_index(gp->filelist,i));
+            run_single_file(gp, (gchar*) g_ptr_array_index(gp->filelist,i));
         }
 
-//      gwy_app_quit ();
-        gtk_main_quit();
+    }
 
+    if (gp->global_range) {
+        export_cached_files(gp);
+        if (gp->remove_cache) {
+            g_rmdir(gp->options.cache_dir);
+        }
+        export_ranges_free(gp->options.ranges);
+        g_ptr_array_foreach(gp->cached, (GFunc)g_free, NULL);
+        g_ptr_array_free(gp->cached, TRUE);
     }
 
+    if (gp->benchmark) {
+        print_benchmark(gp);
+    }
+
+    ret = gp->failed->len ? 1 : 0;
+    if (gp->failed->len) {
+        GC_WARNING(gp, "%u files failed:", gp->failed->len);
+        for (i = 0; i < gp->failed->len; ++i) {
+            GC_WARNING(gp, "  %s", (gchar*) g_ptr_array_index(gp->failed, i));
+        }
+    }
+
+//  gwy_app_quit ();
+    export_context_free(gp->context);
+    archive_close(gp);
+    journal_close(gp);
+    g_string_free(gp->outputs, TRUE);
+    g_ptr_array_foreach(gp->filelist, (GFunc)g_free, NULL);
     g_ptr_array_free(gp->filelist, TRUE);
+    g_ptr_array_foreach(gp->failed, (GFunc)g_free, NULL);
+    g_ptr_array_free(gp->failed, TRUE);
+    g_free(gp->archivepath);
+    g_free(gp->options.filterlist);
+    g_free(gp->options.cache_dir);
+    g_free(gp->outpath);
     g_free(gp);
 
-    return 0;
+    return ret;
 }
 
-/* keys for the polylevel parameters */
-static const gchar col_degree_key[]  = "/module/polylevel/col_degree";
-static const gchar row_degree_key[]  = "/module/polylevel/row_degree";
-static const gchar max_degree_key[]  = "/module/polylevel/max_degree";
-static const gchar do_extract_key[]  = "/module/polylevel/do_extract";
-static const gchar same_degree_key[] = "/module/polylevel/same_degree";
-static const gchar independent_key[] = "/module/polylevel/independent";
-static const gchar masking_key[]     = "/module/polylevel/masking";
-
-/** Executes a process module with GWY_RUN_IMMEDIATE
- *  on the current channel in GwyContainer data
+/** Encodes the image in every available format and accumulates the
+ *  encoding times and sizes
  */
-static gboolean execute_process_module(gchar *procname,
-                                       GwyContainer *data) {
-    if (gwy_process_func_exists(procname)) {
-        gwy_process_func_run(procname,
-                             data, GWY_RUN_IMMEDIATE);
-        return TRUE;
-    } else {
-        //GC_WARNING(gp, "processfunction `%s'"
-        //           " is not available. Ignoring.\n", procname);
-        return FALSE;
+static void
+benchmark_formats(ExportGlobalParameters* gp, GdkPixbuf *pixbuf)
+{
+    GTimer *timer;
+    FileFormat f;
+    gchar *buffer;
+    gsize size;
+    gdouble t;
+
+    timer = g_timer_new();
+    for (f = 0; f < N_FORMATS; f++) {
+        if (!encode_format_available(f))
+            continue;
+        g_timer_start(timer);
+        if (!encode_pixbuf(pixbuf, f, &buffer, &size))
+            continue;
+        t = g_timer_elapsed(timer, NULL);
+        g_free(buffer);
+        gp->bench_time[f] += t;
+        gp->bench_size[f] += size;
+        GC_MESSAGE(gp, "Benchmark %-4s %9.3f ms %10lu bytes",
+                   encode_format_name(f), 1e3*t, (gulong)size);
     }
-    // Never reached
-    return FALSE;
+    g_timer_destroy(timer);
 }
 
+/* Prints the totals of benchmark_formats(), to stderr if stdout
+   carries the outputs */
+static void
+print_benchmark(ExportGlobalParameters* gp)
+{
+    FILE *fp = uses_stdout(gp) ? stderr : stdout;
+    FileFormat f;
+
+    g_fprintf(fp, "%-6s %12s %14s\n", "format", "encode [s]", "size [bytes]");
+    for (f = 0; f < N_FORMATS; f++) {
+        if (!encode_format_available(f))
+            continue;
+        g_fprintf(fp, "%-6s %12.3f %14" G_GUINT64_FORMAT "\n",
+                  encode_format_name(f), gp->bench_time[f],
+                  gp->bench_size[f]);
+    }
+}
 
-/** Applies the designated filters on the
- *  current GwyData
+/* Whether stdout carries the outputs and must not get any text */
+static gboolean
+uses_stdout(ExportGlobalParameters *gp)
+{
+    return gp->stream
+           || (gp->archivepath && gwy_strequal(gp->archivepath, "-"));
+}
+
+static void
+set_stdout_binary(void)
+{
+#if __MSDOS__ || __WIN32__ || _MSC_VER
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+static void
+put_be(guchar *p, guint64 v, gint n)
+{
+    while (n--) {
+        p[n] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+/* Appends a `key=value' line with the value escaped like a C string,
+   except for the bytes of UTF-8 sequences, so it stays on one line */
+static void
+append_header_line(GString *header, const gchar *key, const gchar *value)
+{
+    static gchar exceptions[129];
+    gchar *s;
+    gint i;
+
+    if (!exceptions[0]) {
+        for (i = 0; i < 128; i++)
+            exceptions[i] = (gchar)(128 + i);
+    }
+    s = g_strescape(value, exceptions);
+    g_string_append_printf(header, "%s=%s\n", key, s);
+    g_free(s);
+}
+
+/** Writes an output as a frame to stdout. A frame is
+ *
+ *    "GWXF" | header length (u32 BE) | data length (u64 BE)
+ *    | header | data
+ *
+ *  where the header holds `key=value' lines for source, channel,
+ *  level (of volumes only), title, format and name. Values are escaped
+ *  like C strings, g_strcompress() restores them.
  */
-static gboolean run_filters(GwyContainer *datacont,
-                            GwyContainer *settings,
-                            ExportGlobalParameters *gp,
-                            ExportImageParameters *ip) {
-    gboolean r = TRUE;
-    gchar** filters = NULL;
-    gchar* thisfilter = NULL;
-    gint i=0, len=0;
-    gchar *ptra=NULL, *ptrb=NULL;
-    gint a=0, b=0;
-    gboolean c = FALSE;
-    gchar *temp=NULL;
-
-    if(!gp->filterlist) {
-        GC_WARNING(gp,
-                   "No filterlist given. No filters will be used.");
+static gboolean
+stream_write_frame(ExportGlobalParameters *gp,
+                   const ExportOutput *out,
+                   const gchar *name)
+{
+    guchar prefix[16];
+    GString *header;
+    gboolean ok;
+
+    header = g_string_new(NULL);
+    append_header_line(header, "source", gp->inputfile);
+    g_string_append_printf(header, "channel=%i\n", out->id);
+    if (out->level >= 0)
+        g_string_append_printf(header, "level=%i\n", out->level);
+    append_header_line(header, "title", out->title);
+    append_header_line(header, "format", out->kind);
+    append_header_line(header, "name", name);
+
+    memcpy(prefix, STREAM_MAGIC, 4);
+    put_be(prefix + 4, header->len, 4);
+    put_be(prefix + 8, out->size, 8);
+    ok = (fwrite(prefix, 1, sizeof(prefix), stdout) == sizeof(prefix));
+    ok &= (fwrite(header->str, 1, header->len, stdout) == header->len);
+    ok &= export_output_write(out, stdout);
+    ok &= (fflush(stdout) == 0);
+    g_string_free(header, TRUE);
+
+    return ok;
+}
+
+/** Writes an output either to its own file or, in archive mode, as
+ *  the next entry of the archive named after the file, or as a frame
+ *  on stdout. Files are written under a temporary name and renamed once
+ *  they are complete, so a partial file never carries the final name.
+ */
+static gboolean
+write_output(ExportGlobalParameters *gp,
+             const ExportOutput *out,
+             const gchar *filename)
+{
+    FILE *fp;
+    gchar *name;
+    gboolean ok;
+
+    if (gp->stream) {
+        name = g_path_get_basename(filename);
+        ok = stream_write_frame(gp, out, name);
+        g_free(name);
+        return ok;
+    }
+
+    if (gp->archive) {
+        name = g_path_get_basename(filename);
+        ok = archive_add_entry(gp, name, out);
+        g_free(name);
+        return ok;
+    }
+
+    name = g_strconcat(filename, EXPORT_PARTIAL_SUFFIX, NULL);
+    fp = fopen(name, "wb");
+    if (!fp) {
+        g_free(name);
         return FALSE;
     }
-    filters = g_strsplit(gp->filterlist, EXPORT_FILTER_DELIMITER, 0);
-    if (!filters) {
-        GC_WARNING(gp,
-                   "`%s' is no valid filterlist, using defaults.",
-                  gp->filterlist);
-        filters = g_strsplit(EXPORT_DEFAULT_FILTERLIST,
-                             EXPORT_FILTER_DELIMITER, 0);
-        if (!filters) {
-            GC_WARNING(gp, "No valid default filterlist `%s'. "
-                       "No filters will be applied",
-                       EXPORT_DEFAULT_FILTERLIST);
-            return FALSE;
-        }
+    ok = export_output_write(out, fp);
+    ok &= (fflush(fp) == 0);
+    ok &= (GC_FSYNC(fp) == 0);
+    ok &= (fclose(fp) == 0);
+#if __MSDOS__ || __WIN32__ || _MSC_VER
+    /* rename() does not replace existing files on Windows */
+    if (ok)
+        remove(filename);
+#endif
+    if (ok)
+        ok = (rename(name, filename) == 0);
+    if (!ok)
+        remove(name);
+    g_free(name);
+
+    if (ok) {
+        g_string_append_c(gp->outputs, '\t');
+        g_string_append(gp->outputs, filename);
+    } else {
+        gp->complete = FALSE;
     }
-    while ( (thisfilter = filters[i++]) != NULL) {
-        ptra = NULL;
-        ptrb = NULL;
-        a = 0;
-        b = 0;
-        len = 0;
-        c = FALSE;
-
-        if (gwy_strequal(thisfilter, "pc") ) {
-            /* Plane correct */
-            r &= execute_process_module("level", datacont);
-            STR_APPEND(ip->processing, "Plane level", temp);
-        } else if (gwy_strequal(thisfilter, "melc")) {
-            /* Median line correct */
-            r &= execute_process_module("line_correct_median",datacont);
-            STR_APPEND(ip->processing, "Median line correct", temp);
-        } else if (gwy_strequal(thisfilter, "sr")) {
-            /* Remove Scars */
-            r &= execute_process_module("scars_remove", datacont);
-            STR_APPEND(ip->processing, "Scars remove", temp);
-        } else if (g_str_has_prefix(thisfilter, "poly")) {
-            /* Polylevel */
-            ptra = g_strrstr(thisfilter, ":");
-            ptrb = g_strrstr(ptra, ",");
-            if (! (ptra && ptrb)) {
-                GC_WARNING(gp, "Illegal poly-filter: `%s'. Ignoring.",
-                          thisfilter);
-                r = FALSE;
-                continue;
-            }
-            len = strlen(thisfilter);
-            if( (thisfilter-ptra+1 < len) ) {
-                a = atoi(ptra+1);
-            }
-            if( (thisfilter-ptrb+1 < len) ) {
-                b = atoi(ptrb+1);
-            } else {
-                b = -1;
-            }
-            if ( (a > 0) && (b < 0) ) {
-                b = a;
-            }
-            if ( (a < 0) || (b < 0) ) {
-                GC_WARNING(gp, "Illegal poly grades: `%s'. Ignoring.",
-                          thisfilter);
-                r = FALSE;
-                continue;
-            }
-            gwy_container_set_int32_by_name(settings,
-                                            col_degree_key, a);
-            gwy_container_set_int32_by_name(settings,
-                                            row_degree_key, b);
-            gwy_container_set_int32_by_name(settings,
-                                            max_degree_key, 12);
-            gwy_container_set_enum_by_name (settings,
-                                            masking_key,
-                                            GWY_MASK_IGNORE);
-            gwy_container_set_boolean_by_name(settings,
-                                              do_extract_key, FALSE);
-            gwy_container_set_boolean_by_name(settings,
-                                              same_degree_key, FALSE);
-            gwy_container_set_boolean_by_name(settings,
-                                              independent_key, TRUE);
-            r &= execute_process_module("polylevel", datacont);
-            STR_APPEND(ip->processing,
-                       g_strdup_printf("Polynomial level: (%i,%i)",
-                                       a, b), temp);
-
-        } else if (g_str_has_prefix(thisfilter, "mean")) {
-            /* Mean Filter */
-            ptra = g_strrstr(thisfilter, ":");
-            if(!ptra) {
-                GC_WARNING(gp, "Illegal mean-filter: `%s'. Ignoring.",
-                          thisfilter);
-                r = FALSE;
-                continue;
-            }
-            len = strlen(thisfilter);
-            if (thisfilter-ptra+1 < len) {
-                a = atoi(ptra+1);
-            } else {
-                GC_WARNING(gp, "Illegal mean-filter value: `%s'. "
-                           "Ignoring.", thisfilter);
-                r = FALSE;
-                continue;
-            }
-            if(a <= 0) {
-                GC_WARNING(gp, "Illegal mean value: `%i'. Ignoring.",
-                           a);
-                r = FALSE;
-                continue;
-            }
-            GwyDataField *dfield;
-            gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD,
-                                             &dfield, NULL);
-            gwy_data_field_filter_mean(dfield, a);
-            STR_APPEND(ip->processing,
-                       g_strdup_printf("Mean filer: (%i pixel)",
-                                       a), temp);
-        } else if (g_str_has_prefix(thisfilter, "any")) {
-            /* Execute the given process module */
-            ptra = g_strrstr(thisfilter, ":");
-            if(!ptra) {
-                GC_WARNING(gp, "Illegal any-filter: `%s'. Ignoring.",
-                          thisfilter);
-                r = FALSE;
-                continue;
-            }
-            len = strlen(thisfilter);
-            if (thisfilter-ptra+1 < len) {
-                c = execute_process_module(ptra+1, datacont);
-                if (!c) {
-                    GC_WARNING(gp, "Module `%s' could not be executed.",
-                              ptra+1);
-                    r = FALSE;
-                } else {
-                    STR_APPEND(ip->processing, ptra+1, temp);
-                }
-            } else {
-                GC_WARNING(gp, "Illegal any-filter definition: `%s'.",
-                          thisfilter);
+    return ok;
+}
+
+/** Opens the journal of completed files in the output directory.
+ *  When resuming, the files it already lists are skipped, otherwise
+ *  it is started anew.
+ */
+static gboolean
+journal_open(ExportGlobalParameters *gp)
+{
+    gchar *path, *contents = NULL;
+    gchar **lines, *tab;
+    gint i, n;
+
+    path = g_build_filename(gp->outpath, EXPORT_JOURNAL_NAME, NULL);
+    gp->done = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                     g_free, NULL);
+
+    if (gp->resume && g_file_get_contents(path, &contents, NULL, NULL)) {
+        lines = g_strsplit(contents, "\n", 0);
+        n = g_strv_length(lines);
+        /* The last line is incomplete unless the journal ends with a
+           newline, i.e. it is empty then */
+        for (i = 0; i < n-1; ++i) {
+            if ((tab = strchr(lines[i], '\t'))) {
+                /* Failed files are tried again */
+                if (g_str_has_prefix(tab + 1, EXPORT_JOURNAL_FAILED))
+                    continue;
+                *tab = '\0';
             }
-        } else if ( gwy_strequal(thisfilter, "") ) {
-            /* Empty filter, ignoring. */
-        } else {
-            GC_WARNING(gp, "runfilters: Unknown filter `%s', ignoring.",
-                      thisfilter);
+            if (*lines[i])
+                g_hash_table_insert(gp->done, g_strdup(lines[i]),
+                                    GINT_TO_POINTER(TRUE));
         }
+        g_strfreev(lines);
+        g_free(contents);
+        GC_MESSAGE(gp, "Resuming, %u files already exported.",
+                   g_hash_table_size(gp->done));
     }
-    g_strfreev(filters);
-    return r;
+
+    gp->journal = fopen(path, gp->resume ? "ab" : "wb");
+    if (!gp->journal) {
+        g_warning("Cannot open journal `%s'\n", path);
+    }
+    g_free(path);
+    return gp->journal != NULL;
 }
 
+static gboolean
+journal_is_done(ExportGlobalParameters *gp, const gchar *filename)
+{
+    gchar *key;
+    gboolean done;
 
-static void save_metadata(ExportGlobalParameters* gp, ExportImageParameters* iparams, gint ci)
+    if (!gp->done || !g_hash_table_size(gp->done))
+        return FALSE;
+
+    key = journal_key(filename);
+    done = g_hash_table_lookup(gp->done, key) != NULL;
+    g_free(key);
+    return done;
+}
+
+/** Records the current input file and its outputs as completed, unless
+ *  one of the outputs failed. The renames of the outputs are synced to
+ *  disk with their directory first, then the line, before the next
+ *  file is started.
+ */
+static void
+journal_add(ExportGlobalParameters *gp)
 {
-    gint i;
+    gchar *key;
+
+    if (!gp->journal || !gp->complete)
+        return;
 
-    gchar tmetakey[STRN];
-    GwyContainer *meta=NULL;
-    g_snprintf(tmetakey, STRN, "/%i/meta", ci);
-    if (! (gwy_container_contains_by_name(data, tmetakey) &&
-        (meta = (GwyContainer*)gwy_container_get_object_by_name(
-                                            data, tmetakey))) ) {
-        GC_MESSAGE(gp, "Could not find a channel specific meta container, fall back on channel 0.");
+    if (!sync_directory(gp->outpath)) {
+        GC_WARNING(gp, "Cannot sync `%s', not journaling `%s'",
+                   gp->outpath, gp->inputfile);
+        return;
     }
+    key = journal_key(gp->inputfile);
+    fprintf(gp->journal, "%s%s\n", key, gp->outputs->str);
+    g_free(key);
+    if (fflush(gp->journal) != 0 || GC_FSYNC(gp->journal) != 0)
+        GC_WARNING(gp, "Cannot sync journal for `%s'", gp->inputfile);
+}
 
-    g_snprintf(tmetakey, STRN, "/0/meta");
-    if (! (gwy_container_contains_by_name(data, tmetakey) &&
-        (meta = (GwyContainer*)gwy_container_get_object_by_name(
-                                            data, tmetakey))) ) {
-        GC_WARNING(gp, "Could not find any meta container, no metadata will be dumped.");
-    } else
-    {
-        FILE * fp;
-        GPtrArray *gparray = NULL;
+/** Records a file as failed, with the reason, so a resume tries it
+ *  again. The line is synced like those of completed files.
+ */
+static void
+journal_fail(ExportGlobalParameters *gp,
+             const gchar *filename,
+             const gchar *reason)
+{
+    gchar *key;
 
-        fp = fopen (iparams->metafilename,"w");
-        fprintf(fp, "\"Info:Metadata\" string \"Dumped by %s v%s\"\n",
-                                        PACKAGENAME, VERSION);
-        fprintf(fp, "\"Info:Sourcefile\" string \"%s\"\n", gp->inputfile);
-        gparray = gwy_container_serialize_to_text(meta);
+    if (!gp->journal)
+        return;
 
-        for(i=0; i<gparray->len; ++i) {
-            fprintf(fp, "%s\n", (gchar*) g_ptr_array_index(gparray, i) );
-        }
-        g_ptr_array_free (gparray, TRUE);
+    key = journal_key(filename);
+    fprintf(gp->journal, "%s\t%s%s\n", key, EXPORT_JOURNAL_FAILED, reason);
+    g_free(key);
+    if (fflush(gp->journal) != 0 || GC_FSYNC(gp->journal) != 0)
+        GC_WARNING(gp, "Cannot sync journal for `%s'", filename);
+}
 
-        /* Also save the proccessing filters applied */
-        fprintf(fp, "\"Info:Processing\" string \"%s\"\n", iparams->processing);
+/* Lists a file as failed at the end of the run and in the journal */
+static void
+record_failure(ExportGlobalParameters *gp,
+               const gchar *filename,
+               const gchar *reason)
+{
+    g_ptr_array_add(gp->failed, g_strdup(filename));
+    journal_fail(gp, filename, reason);
+}
 
-        fclose (fp);
-    }
+/** The journal key of an input file, its canonical absolute path
+ *  escaped to a single line, so the same file matches however it is
+ *  spelled on the command line
+ */
+static gchar*
+journal_key(const gchar *filename)
+{
+    gchar *path, *key;
 
+#ifdef __unix__
+    path = realpath(filename, NULL);
+#else
+    path = _fullpath(NULL, filename, 0);
+#endif
+    key = g_strescape(path ? path : filename, NULL);
+    free(path);
+    return key;
 }
 
-static void
-handle_single_channel(ExportGlobalParameters* gp, gint ci)
-{
-    GtkWidget *view;
-    GwyPixmapLayer *layer;
-    GQuark quark;
-    gchar *key, *basename, *newfilename, *ext, *basepath;
-    GwyDataField *dfield;
-    GdkPixbuf *pixbuf;
-    GwyGradient *gradient;
-    gint xres=0, yres=0;
+/* Syncs the entries of a directory, i.e. the files renamed into it */
+static gboolean
+sync_directory(const gchar *path)
+{
+#ifdef __unix__
+    int fd;
     gboolean ok;
-    ExportImageParameters *iparams;
-    gchar *temp=NULL;
-
-    iparams = img_params_new();
-
-    g_return_if_fail( ci < gp->n_channels );
-
-    /* Data view */
-    view = gwy_data_view_new(data);
-    /* The basic data display layer, constructed if called the
-       first time. Each GwyDataView can hold several
-       GwyDataViewLayers */
-    layer = gwy_layer_basic_new();
-
-    /* Set up the locations to display */
-    quark = gwy_app_get_data_key_for_id(gp->channel_ids[ci]);
-    gwy_data_view_set_data_prefix(GWY_DATA_VIEW(view),
-                                  g_quark_to_string(quark));
-    gwy_pixmap_layer_set_data_key(layer, g_quark_to_string(quark));
-    gwy_data_view_set_base_layer(GWY_DATA_VIEW(view), layer);
-
-    /* There is no helper function for palette keys, set it
-       up manually */
-    key = g_strdup_printf("/gwyexport/gradient");
-    if(gp->gradient && (gp->gradient != NULL)) {
-      gwy_layer_basic_set_gradient_key(GWY_LAYER_BASIC(layer), key);
-      g_free(key);
-      STR_APPEND(iparams->processing,
-                 g_strdup_printf("Color gradient: `%s'", gp->gradient),
-                 temp);
-    }
-    if (gp->colormapping && (gp->colormapping > 0)) {
-        key = g_strdup_printf("/gwyexport/rangetype");
-        if (gp->colormapping == CMAP_FULL) {
-            gwy_container_set_int32_by_name(data, key,
-                                      GWY_LAYER_BASIC_RANGE_FULL);
-            gwy_layer_basic_set_range_type_key(GWY_LAYER_BASIC(layer),
-                                               key);
-            STR_APPEND(iparams->processing, "Color Range: Full", temp);
-        } else if (gp->colormapping == CMAP_AUTO) {
-            gwy_container_set_int32_by_name(data, key,
-                                      GWY_LAYER_BASIC_RANGE_AUTO);
-            gwy_layer_basic_set_range_type_key(GWY_LAYER_BASIC(layer),
-                                               key);
-            STR_APPEND(iparams->processing, "Color Range: Auto", temp);
-        } else if (gp->colormapping == CMAP_ADAPTIVE) {
-            gwy_container_set_int32_by_name(data, key,
-                                      GWY_LAYER_BASIC_RANGE_ADAPT);
-            gwy_layer_basic_set_range_type_key(GWY_LAYER_BASIC(layer),
-                                               key);
-            STR_APPEND(iparams->processing,
-                       "Color Range: Adaptive", temp);
-        }
-        g_free(key);
-    }
-
-    /* Select the designated data field */
-    gwy_app_data_browser_select_data_field(data, gp->channel_ids[ci]);
-    gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD, &dfield, NULL);
-    iparams->title = gwy_app_get_data_field_title(data, gp->channel_ids[ci]);
-    g_strdelimit(iparams->title, g_strdup(" "), '_');
-    GC_MESSAGE(gp, "Processing channel %i : %s", gp->channel_ids[ci], iparams->title);
-
-    /* Process the data */
-    run_filters(data, settings, gp, iparams);
-
-    /* Get the colorscale. This works, as `layer' and `pixbuf'
-       have to do the same */
-    gwy_layer_basic_get_range(GWY_LAYER_BASIC(layer),
-                              &(iparams->colormin),
-                              &(iparams->colormax));
-    iparams->scalebar_text = scalebar_auto_length(
-                                gwy_data_field_get_xreal(dfield),
-                                gwy_data_field_get_si_unit_xy(dfield),
-                                &iparams->scalebar_relwidth);
-
-    /* Create the pixbuffer */
-    if (!gp->gradient) gp->gradient = g_strdup("");
-    gradient = gwy_gradients_get_gradient(gp->gradient);
-    gwy_resource_use(GWY_RESOURCE(gradient));
-    xres = gwy_data_field_get_xres(dfield);
-    yres = gwy_data_field_get_yres(dfield);
-    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, xres, yres);
-    if (gp->colormapping == CMAP_AUTO) {
-        gwy_pixbuf_draw_data_field_with_range(pixbuf, dfield, gradient,
-                                              iparams->colormin,
-                                              iparams->colormax);
-    } else if (gp->colormapping == CMAP_FULL) {
-        gwy_pixbuf_draw_data_field(pixbuf, dfield, gradient);
-    } else if (gp->colormapping == CMAP_ADAPTIVE) {
-        gwy_pixbuf_draw_data_field_adaptive(pixbuf, dfield, gradient);
-    } else {
-        GC_MESSAGE(gp, "No color mapping defined. Using adaptive.");
-        gwy_pixbuf_draw_data_field_adaptive(pixbuf, dfield, gradient);
-        STR_APPEND(iparams->processing, "Color Range: Adaptive", temp);
-    }
-
-    g_object_unref(dfield);
-    gwy_resource_release(GWY_RESOURCE(gradient));
-
-    /* Construct filename, path, ident and title  */
-    if(!gp->outpath) gp->outpath = g_get_current_dir();
-
-    basename = g_path_get_basename(gp->inputfile);
-    newfilename = g_strdup_printf("%s-%i-%s", basename, ci, iparams->title);
-    basepath = g_build_filename(gp->outpath, newfilename, NULL);
-    ext = g_strdup(".txt");
-    iparams->metafilename = g_strconcat(basepath, ext, NULL);
-    g_free(ext);
-
-    /* Save the GdkPixBuf to an image file */
-    switch(gp->format){
-        case PNG:
-            ext = g_strdup_printf(".png");
-            iparams->filename = g_strconcat(basepath, ext, NULL);
-            ok = gdk_pixbuf_save(pixbuf, iparams->filename,
-                            "png", NULL,
-                            "compression", "9", NULL);
-            g_free(ext);
-        break;
-        /* set jpeg as default */
-        case JPEG:
-        default:
-            ext = g_strdup(".jpg");
-            iparams->filename = g_strconcat(basepath, ext, NULL);
-            ok = gdk_pixbuf_save(pixbuf, iparams->filename,
-                                 "jpeg", NULL,
-                                 "quality", "90", NULL);
-            g_free(ext);
-        break;
-    }
-    if(!gp->silentmode && ok) {
-        GC_MESSAGE(gp, " => Saved to file `%s'", iparams->filename);
-    }
-    else if (!ok){
-        GC_WARNING(gp, " Error file `%s' not saved", iparams->filename);
-    }
-
-    if(gp->printmetafile) {
-        save_metadata(gp, iparams, ci);
-    }
-
-    g_free(iparams);
-    g_object_unref(pixbuf);
-    gtk_widget_destroy(view);
-    g_free(basepath);
-    g_free(newfilename);
-    g_free(basename);
 
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FALSE;
+    ok = (fsync(fd) == 0);
+    close(fd);
+    return ok;
+#else
+    /* Directories cannot be synced, renames are journaled by NTFS */
+    return TRUE;
+#endif
 }
 
-/** The following function is from modules/file/pixmap.c
- *  Gwyddion 2.19 by David Necas et al.
- */
-static gchar*
-scalebar_auto_length(gdouble real,
-                     GwySIUnit *siunit,
-                     gdouble *p)
-{
-    static const double sizes[] = {
-        1.0, 2.0, 3.0, 4.0, 5.0,
-        10.0, 20.0, 30.0, 40.0, 50.0,
-        100.0, 200.0, 300.0, 400.0, 500.0,
-    };
-    GwySIValueFormat *format;
-    gdouble base, x, vmax;
-    gchar *s;
-    gint power10;
-    guint i;
+static void
+journal_close(ExportGlobalParameters *gp)
+{
+    if (gp->journal)
+        fclose(gp->journal);
+    gp->journal = NULL;
+    if (gp->done)
+        g_hash_table_destroy(gp->done);
+    gp->done = NULL;
+}
 
-    vmax = 0.42*real;
-    power10 = 3*(gint)(floor(log10(vmax)/3.0));
-    base = pow10(power10 + 1e-14);
-    x = vmax/base;
-    for (i = 1; i < G_N_ELEMENTS(sizes); i++) {
-        if (x < sizes[i])
-            break;
+/** Opens the output tar archive, `-' means stdout
+ */
+static gboolean
+archive_open(ExportGlobalParameters *gp)
+{
+    if (gwy_strequal(gp->archivepath, "-")) {
+        set_stdout_binary();
+        gp->archive = stdout;
+    } else {
+        gp->archive = fopen(gp->archivepath, "wb");
+    }
+    if (!gp->archive) {
+        g_warning("Cannot open archive `%s'\n", gp->archivepath);
+        return FALSE;
     }
-    x = sizes[i-1] * base;
+    return TRUE;
+}
 
-    format = gwy_si_unit_get_format_for_power10(siunit,
-                                          GWY_SI_UNIT_FORMAT_VFMARKUP,
-                                          power10, NULL);
-    s = g_strdup_printf("%.*f %s",
-                        format->precision, x/format->magnitude,
-                        format->units);
-    gwy_si_unit_value_format_free(format);
+/* Writes a ustar header block with the checksum filled in */
+static gboolean
+archive_write_header(FILE *fp, const gchar *name, gsize size,
+                     gchar typeflag)
+{
+    guchar header[TAR_BLOCKSIZE];
+    guint checksum = 0;
+    gint i;
 
-    if (p)
-        *p = x/real;
+    memset(header, 0, TAR_BLOCKSIZE);
+    strncpy((gchar*)header, name, 100);
+    g_snprintf((gchar*)header + 100, 8, "%07o", 0644);
+    g_snprintf((gchar*)header + 108, 8, "%07o", 0);
+    g_snprintf((gchar*)header + 116, 8, "%07o", 0);
+    g_snprintf((gchar*)header + 124, 12, "%011lo", (gulong)size);
+    g_snprintf((gchar*)header + 136, 12, "%011lo", (gulong)time(NULL));
+    header[156] = typeflag;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    /* The checksum is computed with its own field set to spaces */
+    memset(header + 148, ' ', 8);
+    for (i = 0; i < TAR_BLOCKSIZE; i++)
+        checksum += header[i];
+    g_snprintf((gchar*)header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+
+    return fwrite(header, 1, TAR_BLOCKSIZE, fp) == TAR_BLOCKSIZE;
+}
 
-    return s;
+/* Pads the data of an entry of size bytes to the block size */
+static gboolean
+archive_write_padding(FILE *fp, gsize size)
+{
+    static const gchar padding[TAR_BLOCKSIZE] = {0};
+    gsize rest = (TAR_BLOCKSIZE - size % TAR_BLOCKSIZE) % TAR_BLOCKSIZE;
+
+    return fwrite(padding, 1, rest, fp) == rest;
 }
 
+/** Appends a file entry to the archive. Names which do not fit the
+ *  ustar header are stored in a preceding pax extended header
+ */
+static gboolean
+archive_add_entry(ExportGlobalParameters *gp,
+                  const gchar *name,
+                  const ExportOutput *out)
+{
+    gchar *record, digits[24];
+    gsize len, n;
+    gboolean ok = TRUE;
+
+    if (strlen(name) >= 100) {
+        /* The record length counts its own decimal digits */
+        len = strlen(" path=\n") + strlen(name);
+        n = len;
+        while (n != len + g_snprintf(digits, sizeof(digits), "%lu",
+                                     (gulong)n))
+            n = len + strlen(digits);
+        record = g_strdup_printf("%lu path=%s\n", (gulong)n, name);
+        ok &= archive_write_header(gp->archive, "././@PaxHeader", n, 'x');
+        ok &= (fwrite(record, 1, n, gp->archive) == n);
+        ok &= archive_write_padding(gp->archive, n);
+        g_free(record);
+    }
+    ok &= archive_write_header(gp->archive, name, out->size, '0');
+    ok &= export_output_write(out, gp->archive);
+    ok &= archive_write_padding(gp->archive, out->size);
+    return ok;
+}
+
+/** Terminates the archive with two empty blocks and closes it
+ */
+static void
+archive_close(ExportGlobalParameters *gp)
+{
+    static const gchar eof[2*TAR_BLOCKSIZE] = {0};
+
+    if (!gp->archive)
+        return;
+    if (fwrite(eof, 1, sizeof(eof), gp->archive) != sizeof(eof))
+        g_warning("Cannot write archive `%s'\n", gp->archivepath);
+    if (gp->archive == stdout)
+        fflush(stdout);
+    else
+        fclose(gp->archive);
+    gp->archive = NULL;
+}
 
 /* Print help */
 static void
@@ -900,13 +1476,68 @@ text file. \n\n",
 " -o, --outpath <output-path> The path, where the exported files are saved.\n"
 "                             If no path is specified images will be stored in\n"
 "                             the current directory.\n"
-" -f, --format <format>       The export format either 'jpg' or 'png'.\n"
+"                             With `-' all outputs are written to stdout as\n"
+"                             frames: \"GWXF\", header length (u32 BE), data\n"
+"                             length (u64 BE), header of key=value lines\n"
+"                             (source, channel, level, title, format, name),\n"
+"                             data. Values are escaped like C strings, e.g.\n"
+"                             a newline as \\n and a backslash as \\\\.\n"
+" -a, --archive <archive>     Writes all images and metadata files into a\n"
+"                             single tar archive instead of separate files.\n"
+"                             Use `-' to write the archive to stdout.\n"
+" -r, --resume                Skips the files listed as completed in the\n"
+"                             journal `%s' of the output path,\n"
+"                             e.g. after an interrupted run. Files listed\n"
+"                             as failed are tried again.\n"
+" -i, --isolate               Processes each file in a separate process, a\n"
+"                             file crashing it is reported and skipped.\n"
+" --timeout <seconds>         Kills an isolated file after this time.\n"
+" --memlimit <MB>             Limits the address space an isolated file may\n"
+"                             use on top of the libraries and modules the\n"
+"                             process starts with. Without /proc the limit\n"
+"                             is on the whole address space, which then\n"
+"                             needs a few hundred MB more.\n"
+" --max-size <pixels>         Downsamples images with a larger side to this\n"
+"                             size by area averaging.\n"
+" --scale <factor>            Downsamples all images by a factor in (0, 1].\n"
+" -f, --format <format>       The export format 'jpg', 'png', 'qoi' or\n"
+"                             'webp' (lossless, if built with libwebp).\n"
+" --global-range              Renders all channels of the same title with the\n"
+"                             same color range, from all the files. A first\n"
+"                             pass processes every file and caches the\n"
+"                             processed data, the second renders the cache.\n"
+"                             The adaptive colormap is then done by\n"
+"                             equalization over all the files. The clip\n"
+"                             percentiles and the equalization are resolved\n"
+"                             to 1/1024 of the range of the channels of a\n"
+"                             title, leaving out 0.1%% at either end of each.\n"
+" --cache <directory>         Where to cache the processed data for\n"
+"                             --global-range, a temporary directory if not\n"
+"                             given.\n"
+" --bands <rows>              Renders and encodes png and jpg images in bands\n"
+"                             of this many rows, without the whole image in\n"
+"                             memory. Channels with the adaptive colormap\n"
+"                             are still rendered whole, except with\n"
+"                             --global-range.\n"
+" --benchmark                 Also encodes every image in all formats and\n"
+"                             prints the encoding times and sizes.\n"
 " -m, --metadata              Will dump the metadata into a text file for each\n"
 "                             channel. The metadata file will have the same\n"
-"                             name and outpath as the image file.\n"
+"                             name and outpath as the image file. It also\n"
+"                             holds min, max, mean, Rq, Ra and skew of the\n"
+"                             processed data.\n"
+" --volumes <images|raw>      Also exports volume data, either each level as\n"
+"                             an image with the range of the whole volume,\n"
+"                             or as a raw stack of little endian floats with\n"
+"                             its layout in a text file.\n"
+" --graphs <csv|bin>          Also exports the curves of graphs as CSV or as\n"
+"                             binary: \"GWXG\", number of curves (u32 LE),\n"
+"                             then for each curve the number of points and\n"
+"                             the description length (u32 LE), the\n"
+"                             description, x and y (f64 LE).\n"
 " -fl, --filters <filters>    Specifies filters applied to each image.\n"
 "                             <filters> is a list, separated by `%s'.\n",
-    EXPORT_FILTER_DELIMITER);
+    EXPORT_JOURNAL_NAME, EXPORT_FILTER_DELIMITER);
     g_printf(
 "                             Filters are processed in given order. \n"
 "                             Filter can be:\n\n"
@@ -915,6 +1546,10 @@ text file. \n\n",
 "                               sr        - Remove scars.\n"
 "                               poly:x,y  - Polylevel with degrees x,y.\n"
 "                               mean:x    - Mean filter of x pixel.\n"
+"                               gauss:s   - Gaussian filter, sigma s pixel.\n"
+"                               median:k  - Median filter of k x k pixel.\n"
+"                               highpass:c - FFT high-pass filter, cut-off\n"
+"                                           c as a fraction of Nyquist.\n"
 "                               any:name  - Process module <name> \n"
 "                                           will be executed.\n"
 "                             Example: -filters pc%smelc%spoly:2,2%smelc\n",
@@ -930,7 +1565,11 @@ text file. \n\n",
 "                             will be used.\n"
 " -c, --colormap <map>        Can be: [auto|full|adaptive] for the \n"
 "                             respective mapping to colors. Default is \n"
-"                             `adaptive'.\n\n"
+"                             `adaptive'.\n"
+"                             clip:l,h maps the l-th to h-th percentile of\n"
+"                             the values, e.g. clip:0.5,99.5.\n"
+"                             equalize spreads the colors evenly over the\n"
+"                             value histogram.\n\n"
                                         );
     g_print("Report bugs to <francois.bianco@unige.ch>\n");
 
@@ -0,0 +1,193 @@
+/*
+ *  gwyexport.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  The libgwyexport interface: loads SPM files with the Gwyddion
+ *  libraries, processes and renders their channels and returns the
+ *  encoded images and metadata in memory
+ *
+ */
+
+#ifndef __GWYEXPORT_H__
+#define __GWYEXPORT_H__
+
+#include <stdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <libgwyddion/gwycontainer.h>
+#include <libprocess/gwyprocess.h>
+
+#include "encode.h"
+#include "stats.h"
+
+typedef enum {
+    CMAP_AUTO,
+    CMAP_ADAPTIVE,
+    CMAP_FULL,
+    CMAP_CLIP,
+    CMAP_EQUALIZE,
+} ExportColormap;
+
+typedef enum {
+    EXPORT_VOLUME_NONE,
+    EXPORT_VOLUME_IMAGES,
+    EXPORT_VOLUME_RAW,
+} ExportVolumeMode;
+
+typedef enum {
+    EXPORT_GRAPH_NONE,
+    EXPORT_GRAPH_CSV,
+    EXPORT_GRAPH_BINARY,
+} ExportGraphMode;
+
+typedef enum {
+    EXPORT_ERROR_INIT,
+    EXPORT_ERROR_LOAD,
+    EXPORT_ERROR_ENCODE,
+    EXPORT_ERROR_CACHE,
+} ExportError;
+
+#define EXPORT_ERROR export_error_quark()
+
+/* Holds the Gwyddion settings, one per process */
+typedef struct _ExportContext ExportContext;
+
+/* A channel kept as data to be colormapped and encoded in bands of
+   rows when it is written */
+typedef struct _ExportBands ExportBands;
+
+/* Color ranges shared over a batch by the channels of the same title */
+typedef struct _ExportRanges ExportRanges;
+
+typedef struct {
+    FileFormat format;
+    gchar* filterlist;
+    gchar* gradient;
+    ExportColormap colormapping;
+    gdouble clip_low;
+    gdouble clip_high;
+    gint maxsize;
+    gdouble scale;
+    /* Also dump the metadata of each channel */
+    gboolean metadata;
+    /* Keep the rendered GdkPixbuf in the result */
+    gboolean keep_pixbuf;
+    /* Also export volume data and graph curves */
+    ExportVolumeMode volumes;
+    ExportGraphMode graphs;
+    /* Render PNG and JPEG in bands of this many rows without the full
+       RGB image, 0 to render whole images */
+    gint band_rows;
+    /* With survey, channels are only processed into the ranges and the
+       processed data cached in cache_dir for export_cache(). Without,
+       channels are rendered with the ranges, if any. */
+    ExportRanges *ranges;
+    gboolean survey;
+    gchar* cache_dir;
+    gboolean silentmode;
+} ExportOptions;
+
+typedef struct {
+    gint id;
+    /* Level of a volume, -1 for channels */
+    gint level;
+    const gchar* title;
+    /* Output name without extension, <source>-<n>-<title> */
+    const gchar* name;
+    const gchar* processing;
+    const gchar* scalebar_text;
+    gdouble scalebar_relwidth;
+    gdouble colormin;
+    gdouble colormax;
+    /* Of the processed data as rendered, only with metadata. Otherwise
+       only min and max, and only for the color ranges which need them. */
+    ChannelStats stats;
+
+    /* Owned by the result, may be taken over by setting them to NULL */
+    GdkPixbuf *pixbuf;
+    gchar *image;
+    gsize image_size;
+    gchar *metadata;
+    gsize metadata_size;
+    /* Set instead of image in band mode, see export_channel_encode() */
+    ExportBands *bands;
+
+    /* Wall-clock times in seconds */
+    gdouble process_time;
+    gdouble render_time;
+    gdouble encode_time;
+
+    /* Set if the channel could not be encoded */
+    GError *error;
+} ExportChannelResult;
+
+/* Any other output, either in a buffer, a volume to be written as a
+   raw stack or a channel to be encoded in bands by export_output_write() */
+typedef struct {
+    gint id;
+    /* Level of a volume, -1 for whole objects */
+    gint level;
+    const gchar* title;
+    /* Output name with extension */
+    const gchar* name;
+    /* Also the extension: raw, txt, csv or bin */
+    const gchar* kind;
+    gchar *buffer;
+    gsize size;
+    GwyBrick *brick;
+    ExportBands *bands;
+} ExportOutput;
+
+typedef struct {
+    const gchar* source;
+    ExportChannelResult *channels;
+    gint n_channels;
+    /* Levels of volumes exported as images */
+    ExportChannelResult *levels;
+    gint n_levels;
+    ExportOutput *outputs;
+    gint n_outputs;
+    gdouble load_time;
+    /* Processed data written by a survey */
+    const gchar* cache;
+
+    /* Owns all the strings of the result */
+    GStringChunk *chunk;
+} ExportResult;
+
+GQuark         export_error_quark    (void);
+ExportContext* export_context_new    (GError **error);
+void           export_context_free   (ExportContext *ctx);
+void           export_options_init   (ExportOptions *options);
+gboolean       export_file           (ExportContext *ctx,
+                                      const gchar *path,
+                                      const ExportOptions *options,
+                                      ExportResult *result,
+                                      GError **error);
+gboolean       export_container      (ExportContext *ctx,
+                                      GwyContainer *data,
+                                      const gchar *source,
+                                      const ExportOptions *options,
+                                      ExportResult *result,
+                                      GError **error);
+gboolean       export_cache          (ExportContext *ctx,
+                                      const gchar *cache,
+                                      const gchar *source,
+                                      const ExportOptions *options,
+                                      ExportResult *result,
+                                      GError **error);
+gboolean       export_channel_encode (ExportChannelResult *channel);
+void           export_levels_encode  (ExportResult *result,
+                                      gint from,
+                                      gint n);
+void           export_result_clear   (ExportResult *result);
+ExportRanges*  export_ranges_new     (void);
+void           export_ranges_free    (ExportRanges *ranges);
+gboolean       export_output_write   (const ExportOutput *output,
+                                      FILE *fp);
+
+#endif /* __GWYEXPORT_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
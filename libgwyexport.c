@@ -0,0 +1,1759 @@
+/*
+ *  libgwyexport.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Based on gwyexport.c from P. Rahe, 30.05.2012, v0.1
+ *  Copyright (C) 2010 Philipp Rahe
+ *  E-mail: hquerquadrat@gmail.com
+ *
+ *  The export core of gwyexport: processes, renders and encodes the
+ *  channels, volumes and graphs of a file in memory, the command line
+ *  tool only writes the results out
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include <glib/gprintf.h>
+
+#include <libgwymodule/gwymodule.h>
+#include <libgwymodule/gwymoduleenums.h>
+#include <libgwymodule/gwymodule-process.h>
+#include <libgwyddion/gwyddion.h>
+#include <libgwydgets/gwydgets.h>
+#include <libprocess/gwyprocess.h>
+#include <libdraw/gwydraw.h>
+#include <libdraw/gwygradient.h>
+#include <app/gwyapp.h>
+#include <libgwyddion/gwycontainer.h>
+#include <libdraw/gwypixfield.h>
+#include <libgwydgets/gwylayer-basic.h>
+
+#include <config.h>
+#include "gwyexport.h"
+#include "private.h"
+#include "filters.h"
+#include "colormap.h"
+#include "volume.h"
+#include "graph.h"
+#include "stats.h"
+
+#define PACKAGENAME "gwyexport"
+
+struct _ExportContext {
+    /* The Gwyddion settings, also holding the module parameters */
+    GwyContainer *settings;
+};
+
+/* String length for metadata keys */
+#define STRN 100
+
+#define STR_APPEND(chunk, s, a) \
+    s = s ? chunk_printf(chunk, "%s, %s", s, a) \
+          : g_string_chunk_insert(chunk, a)
+
+static gboolean run_filters            (GwyContainer *data,
+                                        GwyContainer *settings,
+                                        const ExportOptions *opts,
+                                        ExportResult *res,
+                                        ExportChannelResult *ch);
+static gboolean execute_process_module (gchar *procname,
+                                        GwyContainer *data);
+static GwyDataField* downsample_data_field (GwyDataField *dfield,
+                                            gint nxres,
+                                            gint nyres);
+static gchar* chunk_printf             (GStringChunk *chunk,
+                                        const gchar *format,
+                                        ...);
+static gchar* scalebar_auto_length     (gdouble real,
+                                        GwySIUnit *siunit,
+                                        gdouble *p);
+double pow10 ( double x );
+
+/* Gwyddion can only be initialized once per process */
+static gboolean initialized = FALSE;
+
+GQuark
+export_error_quark(void)
+{
+    return g_quark_from_static_string("gwyexport-error-quark");
+}
+
+/**
+ * export_context_new:
+ * @error: Location to store the error, or %NULL.
+ *
+ * Initializes Gtk+ and Gwyddion with its modules. The context can then
+ * export any number of files.
+ *
+ * Returns: A new export context, or %NULL on failure.
+ */
+ExportContext*
+export_context_new(GError **error)
+{
+    ExportContext *ctx;
+
+    if (!gtk_init_check(NULL, NULL)) {
+        g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_INIT,
+                    "Cannot initialize Gtk+");
+        return NULL;
+    }
+    if (!initialized) {
+        gwy_app_init_common(NULL, "layer", "file", "process", NULL);
+        /* Disable undo function to save memory */
+        gwy_undo_set_enabled(FALSE);
+        gwy_app_data_browser_set_gui_enabled(FALSE);
+        initialized = TRUE;
+    }
+
+    ctx = g_new0(ExportContext, 1);
+    ctx->settings = gwy_app_settings_get();
+    return ctx;
+}
+
+/**
+ * export_context_free:
+ * @ctx: An export context.
+ *
+ * Shuts the data browser down and releases the context, once all the
+ * files are exported.
+ */
+void
+export_context_free(ExportContext *ctx)
+{
+    gwy_app_data_browser_shut_down();
+    filter_free_plans();
+    g_free(ctx);
+}
+
+/* No filters, the default gradient and automatic range to JPEG */
+void
+export_options_init(ExportOptions *options)
+{
+    ExportOptions null = {0};
+
+    *options = null;
+    options->format = JPEG;
+    options->colormapping = CMAP_AUTO;
+}
+
+/* Formats a string into the chunk, it lives as long as the chunk */
+static gchar* chunk_printf(GStringChunk *chunk, const gchar *format, ...) {
+    gchar *s, *r;
+    va_list args;
+
+    va_start(args, format);
+    s = g_strdup_vprintf(format, args);
+    va_end(args);
+    r = g_string_chunk_insert(chunk, s);
+    g_free(s);
+
+    return r;
+}
+
+/* keys for the polylevel parameters */
+static const gchar col_degree_key[]  = "/module/polylevel/col_degree";
+static const gchar row_degree_key[]  = "/module/polylevel/row_degree";
+static const gchar max_degree_key[]  = "/module/polylevel/max_degree";
+static const gchar do_extract_key[]  = "/module/polylevel/do_extract";
+static const gchar same_degree_key[] = "/module/polylevel/same_degree";
+static const gchar independent_key[] = "/module/polylevel/independent";
+static const gchar masking_key[]     = "/module/polylevel/masking";
+
+/** Executes a process module with GWY_RUN_IMMEDIATE
+ *  on the current channel in GwyContainer data
+ */
+static gboolean execute_process_module(gchar *procname,
+                                       GwyContainer *data) {
+    if (gwy_process_func_exists(procname)) {
+        gwy_process_func_run(procname,
+                             data, GWY_RUN_IMMEDIATE);
+        return TRUE;
+    } else {
+        //GC_WARNING(opts, "processfunction `%s'"
+        //           " is not available. Ignoring.\n", procname);
+        return FALSE;
+    }
+    // Never reached
+    return FALSE;
+}
+
+
+/** Applies the designated filters on the
+ *  current GwyData
+ */
+static gboolean run_filters(GwyContainer *datacont,
+                            GwyContainer *settings,
+                            const ExportOptions *opts,
+                            ExportResult *res,
+                            ExportChannelResult *ch) {
+    gboolean r = TRUE;
+    gchar** filters = NULL;
+    gchar* thisfilter = NULL;
+    gint i=0, len=0;
+    gchar *ptra=NULL, *ptrb=NULL;
+    gint a=0, b=0;
+    gdouble x=0.0;
+    gboolean c = FALSE;
+    GwyDataField *dfield;
+
+    if(!opts->filterlist) {
+        GC_WARNING(opts,
+                   "No filterlist given. No filters will be used.");
+        return FALSE;
+    }
+    filters = g_strsplit(opts->filterlist, EXPORT_FILTER_DELIMITER, 0);
+    if (!filters) {
+        GC_WARNING(opts,
+                   "`%s' is no valid filterlist, using defaults.",
+                  opts->filterlist);
+        filters = g_strsplit(EXPORT_DEFAULT_FILTERLIST,
+                             EXPORT_FILTER_DELIMITER, 0);
+        if (!filters) {
+            GC_WARNING(opts, "No valid default filterlist `%s'. "
+                       "No filters will be applied",
+                       EXPORT_DEFAULT_FILTERLIST);
+            return FALSE;
+        }
+    }
+    while ( (thisfilter = filters[i++]) != NULL) {
+        ptra = NULL;
+        ptrb = NULL;
+        a = 0;
+        b = 0;
+        len = 0;
+        c = FALSE;
+
+        if (gwy_strequal(thisfilter, "pc") ) {
+            /* Plane correct */
+            r &= execute_process_module("level", datacont);
+            STR_APPEND(res->chunk, ch->processing, "Plane level");
+        } else if (gwy_strequal(thisfilter, "melc")) {
+            /* Median line correct */
+            r &= execute_process_module("line_correct_median",datacont);
+            STR_APPEND(res->chunk, ch->processing, "Median line correct");
+        } else if (gwy_strequal(thisfilter, "sr")) {
+            /* Remove Scars */
+            r &= execute_process_module("scars_remove", datacont);
+            STR_APPEND(res->chunk, ch->processing, "Scars remove");
+        } else if (g_str_has_prefix(thisfilter, "poly")) {
+            /* Polylevel */
+            ptra = g_strrstr(thisfilter, ":");
+            ptrb = g_strrstr(ptra, ",");
+            if (! (ptra && ptrb)) {
+                GC_WARNING(opts, "Illegal poly-filter: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            len = strlen(thisfilter);
+            if( (thisfilter-ptra+1 < len) ) {
+                a = atoi(ptra+1);
+            }
+            if( (thisfilter-ptrb+1 < len) ) {
+                b = atoi(ptrb+1);
+            } else {
+                b = -1;
+            }
+            if ( (a > 0) && (b < 0) ) {
+                b = a;
+            }
+            if ( (a < 0) || (b < 0) ) {
+                GC_WARNING(opts, "Illegal poly grades: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            gwy_container_set_int32_by_name(settings,
+                                            col_degree_key, a);
+            gwy_container_set_int32_by_name(settings,
+                                            row_degree_key, b);
+            gwy_container_set_int32_by_name(settings,
+                                            max_degree_key, 12);
+            gwy_container_set_enum_by_name (settings,
+                                            masking_key,
+                                            GWY_MASK_IGNORE);
+            gwy_container_set_boolean_by_name(settings,
+                                              do_extract_key, FALSE);
+            gwy_container_set_boolean_by_name(settings,
+                                              same_degree_key, FALSE);
+            gwy_container_set_boolean_by_name(settings,
+                                              independent_key, TRUE);
+            r &= execute_process_module("polylevel", datacont);
+            STR_APPEND(res->chunk, ch->processing,
+                       chunk_printf(res->chunk,
+                                    "Polynomial level: (%i,%i)",
+                                    a, b));
+
+        } else if (g_str_has_prefix(thisfilter, "mean")) {
+            /* Mean Filter */
+            ptra = g_strrstr(thisfilter, ":");
+            if(!ptra) {
+                GC_WARNING(opts, "Illegal mean-filter: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            len = strlen(thisfilter);
+            if (thisfilter-ptra+1 < len) {
+                a = atoi(ptra+1);
+            } else {
+                GC_WARNING(opts, "Illegal mean-filter value: `%s'. "
+                           "Ignoring.", thisfilter);
+                r = FALSE;
+                continue;
+            }
+            if(a <= 0) {
+                GC_WARNING(opts, "Illegal mean value: `%i'. Ignoring.",
+                           a);
+                r = FALSE;
+                continue;
+            }
+            gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD,
+                                             &dfield, NULL);
+            gwy_data_field_filter_mean(dfield, a);
+            STR_APPEND(res->chunk, ch->processing,
+                       chunk_printf(res->chunk,
+                                    "Mean filer: (%i pixel)", a));
+        } else if (g_str_has_prefix(thisfilter, "gauss")) {
+            /* Gaussian Filter */
+            ptra = g_strrstr(thisfilter, ":");
+            x = ptra ? g_ascii_strtod(ptra+1, NULL) : 0.0;
+            if (!(x > 0.0)) {
+                GC_WARNING(opts, "Illegal gauss-filter: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD,
+                                             &dfield, NULL);
+            filter_gaussian(dfield, x);
+            STR_APPEND(res->chunk, ch->processing,
+                       chunk_printf(res->chunk,
+                                    "Gaussian filter: (%g pixel)", x));
+        } else if (g_str_has_prefix(thisfilter, "median")) {
+            /* Median Filter */
+            ptra = g_strrstr(thisfilter, ":");
+            a = ptra ? atoi(ptra+1) : 0;
+            if (a <= 0) {
+                GC_WARNING(opts, "Illegal median-filter: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD,
+                                             &dfield, NULL);
+            filter_median(dfield, a);
+            STR_APPEND(res->chunk, ch->processing,
+                       chunk_printf(res->chunk,
+                                    "Median filter: (%i pixel)", a));
+        } else if (g_str_has_prefix(thisfilter, "highpass")) {
+            /* FFT High-pass Filter */
+            ptra = g_strrstr(thisfilter, ":");
+            x = ptra ? g_ascii_strtod(ptra+1, NULL) : 0.0;
+            if (!(x > 0.0)) {
+                GC_WARNING(opts, "Illegal highpass-filter: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD,
+                                             &dfield, NULL);
+            filter_highpass(dfield, x);
+            STR_APPEND(res->chunk, ch->processing,
+                       chunk_printf(res->chunk,
+                                    "High-pass filter: (%g Nyquist)",
+                                    x));
+        } else if (g_str_has_prefix(thisfilter, "any")) {
+            /* Execute the given process module */
+            ptra = g_strrstr(thisfilter, ":");
+            if(!ptra) {
+                GC_WARNING(opts, "Illegal any-filter: `%s'. Ignoring.",
+                          thisfilter);
+                r = FALSE;
+                continue;
+            }
+            len = strlen(thisfilter);
+            if (thisfilter-ptra+1 < len) {
+                c = execute_process_module(ptra+1, datacont);
+                if (!c) {
+                    GC_WARNING(opts, "Module `%s' could not be executed.",
+                              ptra+1);
+                    r = FALSE;
+                } else {
+                    STR_APPEND(res->chunk, ch->processing, ptra+1);
+                }
+            } else {
+                GC_WARNING(opts, "Illegal any-filter definition: `%s'.",
+                          thisfilter);
+            }
+        } else if ( gwy_strequal(thisfilter, "") ) {
+            /* Empty filter, ignoring. */
+        } else {
+            GC_WARNING(opts, "runfilters: Unknown filter `%s', ignoring.",
+                      thisfilter);
+        }
+    }
+    g_strfreev(filters);
+    return r;
+}
+
+
+
+typedef struct {
+    gint from;
+    gint to;
+    gdouble wfrom;
+    gdouble wto;
+} ResampleSpan;
+
+/* Computes which source pixels each of the nres target pixels covers
+   and the covered fractions of the first and last one */
+static ResampleSpan*
+resample_spans(gint res, gint nres)
+{
+    ResampleSpan *spans = g_new(ResampleSpan, nres);
+    gdouble f = (gdouble)res/nres, a, b;
+    gint j;
+
+    for (j = 0; j < nres; j++) {
+        a = j*f;
+        b = MIN((j + 1)*f, res);
+        spans[j].from = (gint)floor(a);
+        spans[j].to = MAX(spans[j].from, MIN((gint)ceil(b) - 1, res - 1));
+        spans[j].wfrom = MIN(spans[j].from + 1, b) - a;
+        spans[j].wto = b - spans[j].to;
+    }
+    return spans;
+}
+
+/** Downsamples a data field by averaging over the area of each new
+ *  pixel. Rows are reduced first, each new pixel summing its own span
+ *  of the row, then whole reduced rows are accumulated, which is the
+ *  loop over contiguous memory that vectorizes.
+ */
+static GwyDataField*
+downsample_data_field(GwyDataField *dfield, gint nxres, gint nyres)
+{
+    GwyDataField *result;
+    ResampleSpan *xspans, *yspans;
+    const gdouble *d, *row;
+    gdouble *tmp, *r, *t, s, w, q;
+    gint xres, yres, i, j, k;
+
+    xres = gwy_data_field_get_xres(dfield);
+    yres = gwy_data_field_get_yres(dfield);
+    d = gwy_data_field_get_data_const(dfield);
+
+    result = gwy_data_field_new(nxres, nyres,
+                                gwy_data_field_get_xreal(dfield),
+                                gwy_data_field_get_yreal(dfield), TRUE);
+    gwy_data_field_set_xoffset(result, gwy_data_field_get_xoffset(dfield));
+    gwy_data_field_set_yoffset(result, gwy_data_field_get_yoffset(dfield));
+    gwy_serializable_clone(G_OBJECT(gwy_data_field_get_si_unit_xy(dfield)),
+                           G_OBJECT(gwy_data_field_get_si_unit_xy(result)));
+    gwy_serializable_clone(G_OBJECT(gwy_data_field_get_si_unit_z(dfield)),
+                           G_OBJECT(gwy_data_field_get_si_unit_z(result)));
+    r = gwy_data_field_get_data(result);
+
+    xspans = resample_spans(xres, nxres);
+    yspans = resample_spans(yres, nyres);
+    tmp = g_new(gdouble, nxres*yres);
+
+    q = (gdouble)nxres/xres;
+    for (i = 0; i < yres; i++) {
+        row = d + i*xres;
+        t = tmp + i*nxres;
+        for (j = 0; j < nxres; j++) {
+            s = xspans[j].wfrom*row[xspans[j].from];
+            for (k = xspans[j].from + 1; k < xspans[j].to; k++)
+                s += row[k];
+            if (xspans[j].to > xspans[j].from)
+                s += xspans[j].wto*row[xspans[j].to];
+            t[j] = q*s;
+        }
+    }
+
+    q = (gdouble)nyres/yres;
+    for (i = 0; i < nyres; i++) {
+        t = r + i*nxres;
+        for (k = yspans[i].from; k <= yspans[i].to; k++) {
+            if (k == yspans[i].from)
+                w = q*yspans[i].wfrom;
+            else if (k == yspans[i].to)
+                w = q*yspans[i].wto;
+            else
+                w = q;
+            row = tmp + k*nxres;
+            for (j = 0; j < nxres; j++)
+                t[j] += w*row[j];
+        }
+    }
+
+    g_free(tmp);
+    g_free(xspans);
+    g_free(yspans);
+    gwy_data_field_invalidate(result);
+
+    return result;
+}
+
+/** The following function is from modules/file/pixmap.c
+ *  Gwyddion 2.19 by David Necas et al.
+ */
+static gchar*
+scalebar_auto_length(gdouble real,
+                     GwySIUnit *siunit,
+                     gdouble *p)
+{
+    static const double sizes[] = {
+        1.0, 2.0, 3.0, 4.0, 5.0,
+        10.0, 20.0, 30.0, 40.0, 50.0,
+        100.0, 200.0, 300.0, 400.0, 500.0,
+    };
+    GwySIValueFormat *format;
+    gdouble base, x, vmax;
+    gchar *s;
+    gint power10;
+    guint i;
+
+    vmax = 0.42*real;
+    power10 = 3*(gint)(floor(log10(vmax)/3.0));
+    base = pow10(power10 + 1e-14);
+    x = vmax/base;
+    for (i = 1; i < G_N_ELEMENTS(sizes); i++) {
+        if (x < sizes[i])
+            break;
+    }
+    x = sizes[i-1] * base;
+
+    format = gwy_si_unit_get_format_for_power10(siunit,
+                                          GWY_SI_UNIT_FORMAT_VFMARKUP,
+                                          power10, NULL);
+    s = g_strdup_printf("%.*f %s",
+                        format->precision, x/format->magnitude,
+                        format->units);
+    gwy_si_unit_value_format_free(format);
+
+    if (p)
+        *p = x/real;
+
+    return s;
+}
+
+
+/** Serializes the metadata of a channel, falling back on those of
+ *  channel 0, followed by the processing applied
+ */
+static gchar*
+build_metadata(GwyContainer *data, const gchar *source,
+               const ExportOptions *opts, ExportChannelResult *ch,
+               gsize *size)
+{
+    gint i;
+    GString *text;
+    GPtrArray *gparray = NULL;
+    GwyDataField *dfield;
+    gchar *s, buf[G_ASCII_DTOSTR_BUF_SIZE];
+    const struct {
+        const gchar *name;
+        gdouble value;
+    } stats[] = {
+        { "Min",  ch->stats.min  },
+        { "Max",  ch->stats.max  },
+        { "Mean", ch->stats.mean },
+        { "Rq",   ch->stats.rq   },
+        { "Ra",   ch->stats.ra   },
+        { "Skew", ch->stats.skew },
+    };
+
+    gchar tmetakey[STRN];
+    GwyContainer *meta=NULL;
+    g_snprintf(tmetakey, STRN, "/%i/meta", ch->id);
+    if (! (gwy_container_contains_by_name(data, tmetakey) &&
+        (meta = (GwyContainer*)gwy_container_get_object_by_name(
+                                            data, tmetakey))) ) {
+        GC_MESSAGE(opts, "Could not find a channel specific meta container, fall back on channel 0.");
+
+        g_snprintf(tmetakey, STRN, "/0/meta");
+        if (! (gwy_container_contains_by_name(data, tmetakey) &&
+            (meta = (GwyContainer*)gwy_container_get_object_by_name(
+                                                data, tmetakey))) ) {
+            GC_WARNING(opts, "Could not find any meta container, no metadata will be dumped.");
+            return NULL;
+        }
+    }
+
+    text = g_string_new(NULL);
+    g_string_append_printf(text,
+                           "\"Info:Metadata\" string \"Dumped by %s v%s\"\n",
+                           PACKAGENAME, VERSION);
+    g_string_append_printf(text, "\"Info:Sourcefile\" string \"%s\"\n",
+                           source);
+    gparray = gwy_container_serialize_to_text(meta);
+
+    for(i=0; i<gparray->len; ++i) {
+        g_string_append_printf(text, "%s\n",
+                               (gchar*) g_ptr_array_index(gparray, i) );
+    }
+    g_ptr_array_free (gparray, TRUE);
+
+    /* Also save the proccessing filters applied */
+    g_string_append_printf(text, "\"Info:Processing\" string \"%s\"\n",
+                           ch->processing);
+
+    /* And the statistics of the processed data */
+    dfield = GWY_DATA_FIELD(gwy_container_get_object(data,
+                                gwy_app_get_data_key_for_id(ch->id)));
+    s = gwy_si_unit_get_string(gwy_data_field_get_si_unit_z(dfield),
+                               GWY_SI_UNIT_FORMAT_PLAIN);
+    g_string_append_printf(text, "\"Info:Stats:Unit\" string \"%s\"\n", s);
+    g_free(s);
+    for (i = 0; i < G_N_ELEMENTS(stats); i++) {
+        g_string_append_printf(text, "\"Info:Stats:%s\" double %s\n",
+                               stats[i].name,
+                               g_ascii_formatd(buf, sizeof(buf), "%.8g",
+                                               stats[i].value));
+    }
+
+    *size = text->len;
+    return g_string_free(text, FALSE);
+}
+
+/* keys for the data view set up */
+static const gchar gradient_key[]  = "/gwyexport/gradient";
+static const gchar rangetype_key[] = "/gwyexport/rangetype";
+/* Processing of a channel cached by a survey, by id */
+static const gchar processed_key[] = "/gwyexport/processed/%i";
+
+/* Summary of the surveyed channels of one title */
+typedef struct {
+    gdouble min;
+    gdouble max;
+    /* Union of the auto ranges of their layers */
+    gdouble automin;
+    gdouble automax;
+    /* Values of the channels over the union of their robust ranges,
+       turned into the merged histogram at the first lookup. Only for
+       the clip, equalize and adaptive mappings. */
+    ColorAccumulator *acc;
+    ColorHistogram *merged;
+} SharedRange;
+
+struct _ExportRanges {
+    /* Title of the channels to SharedRange */
+    GHashTable *titles;
+    /* Cache files written, numbering the next one */
+    guint n_cached;
+};
+
+static void
+shared_range_free(SharedRange *range)
+{
+    if (range->acc)
+        color_accumulator_free(range->acc);
+    if (range->merged)
+        color_histogram_free(range->merged);
+    g_free(range);
+}
+
+/**
+ * export_ranges_new:
+ *
+ * Creates the ranges of a batch exported in two passes: a survey of
+ * all the files with ExportOptions.survey set, then export_cache() of
+ * each file cached by the survey, with the same ranges.
+ *
+ * Returns: New empty ranges, free with export_ranges_free().
+ */
+ExportRanges*
+export_ranges_new(void)
+{
+    ExportRanges *ranges = g_new0(ExportRanges, 1);
+
+    ranges->titles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify)shared_range_free);
+    return ranges;
+}
+
+void
+export_ranges_free(ExportRanges *ranges)
+{
+    g_hash_table_destroy(ranges->titles);
+    g_free(ranges);
+}
+
+/* Whether channels with a shared range are equalized by the
+   accumulated histogram, which also stands for the adaptive mapping */
+static gboolean
+shared_range_equalized(const ExportOptions *opts)
+{
+    return (opts->colormapping != CMAP_AUTO
+            && opts->colormapping != CMAP_FULL
+            && opts->colormapping != CMAP_CLIP);
+}
+
+/* Adds a surveyed channel to the range of its title */
+static void
+ranges_add(ExportRanges *ranges,
+           GwyDataField *dfield,
+           const ExportOptions *opts,
+           const ExportChannelResult *ch)
+{
+    SharedRange *range;
+    ColorHistogram *hist;
+
+    range = (SharedRange*)g_hash_table_lookup(ranges->titles, ch->title);
+    if (!range) {
+        range = g_new0(SharedRange, 1);
+        range->min = ch->stats.min;
+        range->max = ch->stats.max;
+        range->automin = ch->colormin;
+        range->automax = ch->colormax;
+        if (opts->colormapping == CMAP_CLIP || shared_range_equalized(opts))
+            range->acc = color_accumulator_new();
+        g_hash_table_insert(ranges->titles, g_strdup(ch->title), range);
+    }
+    range->min = MIN(range->min, ch->stats.min);
+    range->max = MAX(range->max, ch->stats.max);
+    range->automin = MIN(range->automin, ch->colormin);
+    range->automax = MAX(range->automax, ch->colormax);
+    if (range->acc) {
+        /* Only the robust range of the channel widens the accumulator,
+           its outliers go to the end bins */
+        hist = color_histogram_new_robust(dfield,
+                                          ch->stats.min, ch->stats.max);
+        color_accumulator_add(range->acc, dfield, hist->min, hist->max);
+        color_histogram_free(hist);
+    }
+}
+
+/* The range of the channels of a title, once all are surveyed */
+static const SharedRange*
+ranges_lookup(ExportRanges *ranges, const gchar *title)
+{
+    SharedRange *range;
+
+    range = (SharedRange*)g_hash_table_lookup(ranges->titles, title);
+    if (range && range->acc) {
+        range->merged = color_accumulator_histogram(range->acc);
+        color_accumulator_free(range->acc);
+        range->acc = NULL;
+    }
+    return range;
+}
+
+/* Sets the color range of ch to the shared one */
+static void
+shared_range_apply(const SharedRange *range,
+                   const ExportOptions *opts,
+                   ExportChannelResult *ch)
+{
+    if (opts->colormapping == CMAP_AUTO) {
+        ch->colormin = range->automin;
+        ch->colormax = range->automax;
+    } else if (opts->colormapping == CMAP_CLIP) {
+        /* The merged histogram leaves the outermost values out */
+        ch->colormin = opts->clip_low > 0.0
+                       ? color_histogram_percentile(range->merged, NULL,
+                                                    opts->clip_low)
+                       : range->min;
+        ch->colormax = opts->clip_high < 100.0
+                       ? color_histogram_percentile(range->merged, NULL,
+                                                    opts->clip_high)
+                       : range->max;
+    } else {
+        ch->colormin = range->min;
+        ch->colormax = range->max;
+    }
+}
+
+struct _ExportBands {
+    GwyDataField *dfield;
+    /* Or the level of a volume, copied out when it is encoded */
+    GwyBrick *brick;
+    gint level;
+    GwyGradient *gradient;
+    const guchar *samples;
+    gint nsamples;
+    gdouble min;
+    gdouble max;
+    /* Equalized mapping if set, linear from min to max otherwise */
+    ColorHistogram *hist;
+    gdouble cdf[COLORMAP_BINS + 1];
+    FileFormat format;
+    /* 0 to render the whole image at once */
+    gint rows;
+};
+
+/** Sets up the band rendering of dfield with the same color range as
+ *  the pixbuf one, or the shared one already in ch. The adaptive
+ *  range of Gwyddion only exists on pixbufs, it is approximated by
+ *  histogram equalization.
+ */
+static ExportBands*
+bands_new(GwyDataField *dfield,
+          GwyGradient *gradient,
+          const ExportOptions *opts,
+          const SharedRange *shared,
+          ExportChannelResult *ch)
+{
+    ExportBands *bands;
+    ColorHistogram *hist;
+
+    bands = g_new0(ExportBands, 1);
+    bands->dfield = g_object_ref(dfield);
+    bands->gradient = gradient;
+    gwy_resource_use(GWY_RESOURCE(gradient));
+    bands->samples = gwy_gradient_get_samples(gradient, &bands->nsamples);
+    bands->format = opts->format;
+    bands->rows = opts->band_rows;
+
+    if (shared) {
+        if (shared_range_equalized(opts)) {
+            bands->hist = g_new(ColorHistogram, 1);
+            *bands->hist = *shared->merged;
+            color_histogram_cdf(bands->hist, bands->cdf);
+        }
+    } else if (opts->colormapping == CMAP_CLIP) {
+        hist = color_histogram_new_range(dfield,
+                                         ch->stats.min, ch->stats.max);
+        ch->colormin = color_histogram_percentile(hist, dfield,
+                                                  opts->clip_low);
+        ch->colormax = color_histogram_percentile(hist, dfield,
+                                                  opts->clip_high);
+        color_histogram_free(hist);
+    } else if (opts->colormapping == CMAP_EQUALIZE) {
+        bands->hist = color_histogram_new_robust(dfield,
+                                                 ch->stats.min,
+                                                 ch->stats.max);
+        color_histogram_cdf(bands->hist, bands->cdf);
+        ch->colormin = bands->hist->min;
+        ch->colormax = bands->hist->max;
+    }
+    bands->min = ch->colormin;
+    bands->max = ch->colormax;
+    return bands;
+}
+
+/** Sets up the rendering of a volume level with the range min to max
+ *  when it is encoded, so only the level being written is in memory
+ */
+static ExportBands*
+level_bands_new(GwyBrick *brick,
+                gint level,
+                GwyGradient *gradient,
+                const ExportOptions *opts,
+                gdouble min,
+                gdouble max)
+{
+    ExportBands *bands;
+
+    bands = g_new0(ExportBands, 1);
+    bands->brick = g_object_ref(brick);
+    bands->level = level;
+    bands->gradient = gradient;
+    gwy_resource_use(GWY_RESOURCE(gradient));
+    bands->samples = gwy_gradient_get_samples(gradient, &bands->nsamples);
+    bands->format = opts->format;
+    bands->rows = encode_rows_available(opts->format) ? opts->band_rows : 0;
+    bands->min = min;
+    bands->max = max;
+    return bands;
+}
+
+static void
+bands_free(ExportBands *bands)
+{
+    if (bands->hist)
+        color_histogram_free(bands->hist);
+    gwy_resource_release(GWY_RESOURCE(bands->gradient));
+    if (bands->dfield)
+        g_object_unref(bands->dfield);
+    if (bands->brick)
+        g_object_unref(bands->brick);
+    g_free(bands);
+}
+
+/* Colormaps n rows from row `from' for the encoder */
+static void
+bands_fill(gpointer user_data, gint from, gint n, guchar *rgb)
+{
+    ExportBands *bands = (ExportBands*)user_data;
+    gint xres = gwy_data_field_get_xres(bands->dfield);
+    const gdouble *d = gwy_data_field_get_data_const(bands->dfield)
+                       + (gsize)from*xres;
+
+    if (bands->hist)
+        colormap_map_equalized(d, n*xres, rgb,
+                               bands->samples, bands->nsamples,
+                               bands->hist, bands->cdf);
+    else
+        colormap_map_linear(d, n*xres, rgb,
+                            bands->samples, bands->nsamples,
+                            bands->min, bands->max);
+}
+
+/* Renders the whole image and encodes it either to fp or into a new
+   buffer */
+static gboolean
+bands_encode_whole(ExportBands *bands, FILE *fp, gchar **buffer, gsize *size)
+{
+    GdkPixbuf *pixbuf;
+    gchar *image;
+    gsize n;
+    gboolean ok;
+
+    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8,
+                            gwy_data_field_get_xres(bands->dfield),
+                            gwy_data_field_get_yres(bands->dfield));
+    gwy_pixbuf_draw_data_field_with_range(pixbuf, bands->dfield,
+                                          bands->gradient,
+                                          bands->min, bands->max);
+    ok = encode_pixbuf(pixbuf, bands->format, &image, &n);
+    g_object_unref(pixbuf);
+    if (!ok)
+        return FALSE;
+    if (buffer) {
+        *buffer = image;
+        *size = n;
+        return TRUE;
+    }
+    ok = (fwrite(image, 1, n, fp) == n);
+    g_free(image);
+    return ok;
+}
+
+/* Encodes the bands either to fp or into a new buffer. A volume level
+   is copied out for the time of the encoding only. */
+static gboolean
+bands_encode(ExportBands *bands, FILE *fp, gchar **buffer, gsize *size)
+{
+    gboolean ok;
+
+    if (bands->brick)
+        bands->dfield = volume_level_new(bands->brick, bands->level);
+    if (bands->rows > 0)
+        ok = encode_rows(gwy_data_field_get_xres(bands->dfield),
+                         gwy_data_field_get_yres(bands->dfield),
+                         bands->rows, bands->format,
+                         bands_fill, bands, fp, buffer, size);
+    else
+        ok = bands_encode_whole(bands, fp, buffer, size);
+    if (bands->brick) {
+        g_object_unref(bands->dfield);
+        bands->dfield = NULL;
+    }
+    return ok;
+}
+
+/** Renders dfield into a new pixbuf with the color mapping of opts,
+ *  over the shared range already in ch if given
+ */
+static GdkPixbuf*
+render_pixbuf(GwyDataField *dfield,
+              GwyGradient *gradient,
+              const ExportOptions *opts,
+              const SharedRange *shared,
+              ExportResult *res,
+              ExportChannelResult *ch)
+{
+    GdkPixbuf *pixbuf;
+    ColorHistogram *hist;
+
+    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8,
+                            gwy_data_field_get_xres(dfield),
+                            gwy_data_field_get_yres(dfield));
+    if (shared && shared_range_equalized(opts)) {
+        colormap_draw_equalized(pixbuf, dfield, gradient, shared->merged);
+    } else if (shared) {
+        gwy_pixbuf_draw_data_field_with_range(pixbuf, dfield, gradient,
+                                              ch->colormin,
+                                              ch->colormax);
+    } else if (opts->colormapping == CMAP_CLIP) {
+        hist = color_histogram_new_range(dfield,
+                                         ch->stats.min, ch->stats.max);
+        ch->colormin = color_histogram_percentile(hist, dfield,
+                                                  opts->clip_low);
+        ch->colormax = color_histogram_percentile(hist, dfield,
+                                                  opts->clip_high);
+        color_histogram_free(hist);
+        gwy_pixbuf_draw_data_field_with_range(pixbuf, dfield, gradient,
+                                              ch->colormin,
+                                              ch->colormax);
+    } else if (opts->colormapping == CMAP_EQUALIZE) {
+        hist = color_histogram_new_robust(dfield,
+                                          ch->stats.min, ch->stats.max);
+        ch->colormin = hist->min;
+        ch->colormax = hist->max;
+        colormap_draw_equalized(pixbuf, dfield, gradient, hist);
+        color_histogram_free(hist);
+    } else if (opts->colormapping == CMAP_AUTO
+               || opts->colormapping == CMAP_FULL) {
+        gwy_pixbuf_draw_data_field_with_range(pixbuf, dfield, gradient,
+                                              ch->colormin,
+                                              ch->colormax);
+    } else if (opts->colormapping == CMAP_ADAPTIVE) {
+        gwy_pixbuf_draw_data_field_adaptive(pixbuf, dfield, gradient);
+    } else {
+        GC_MESSAGE(opts, "No color mapping defined. Using adaptive.");
+        gwy_pixbuf_draw_data_field_adaptive(pixbuf, dfield, gradient);
+        STR_APPEND(res->chunk, ch->processing, "Color Range: Adaptive");
+    }
+    return pixbuf;
+}
+
+/** Runs the filters on the channel of data at quark and shrinks it to
+ *  the output size. Returns the processed data field, and the text of
+ *  the processing in `text', also appended to ch->processing.
+ */
+static GwyDataField*
+process_channel(ExportContext *ctx,
+                GwyContainer *data,
+                const ExportOptions *opts,
+                ExportResult *res,
+                ExportChannelResult *ch,
+                GQuark quark,
+                GwyDataField *dfield,
+                const gchar **text)
+{
+    const gchar *before = ch->processing;
+    gint xres, yres;
+    gdouble f;
+
+    ch->processing = NULL;
+    run_filters(data, ctx->settings, opts, res, ch);
+
+    /* Shrink the processed data to the output size, so only the
+       pixels written are colormapped and encoded */
+    xres = gwy_data_field_get_xres(dfield);
+    yres = gwy_data_field_get_yres(dfield);
+    f = 1.0;
+    if (opts->scale > 0.0)
+        f = opts->scale;
+    if (opts->maxsize > 0 && f*MAX(xres, yres) > opts->maxsize)
+        f = (gdouble)opts->maxsize/MAX(xres, yres);
+    if (f < 1.0) {
+        dfield = downsample_data_field(dfield,
+                                       MAX(1, GWY_ROUND(f*xres)),
+                                       MAX(1, GWY_ROUND(f*yres)));
+        gwy_container_set_object(data, quark, dfield);
+        g_object_unref(dfield);
+        STR_APPEND(res->chunk, ch->processing,
+                   chunk_printf(res->chunk, "Downsampled: %ix%i to %ix%i",
+                                xres, yres,
+                                gwy_data_field_get_xres(dfield),
+                                gwy_data_field_get_yres(dfield)));
+    }
+
+    *text = ch->processing ? ch->processing : "";
+    ch->processing = before;
+    if (**text) {
+        STR_APPEND(res->chunk, ch->processing, *text);
+    }
+    return dfield;
+}
+
+/* Whether the color mapping of opts can be done band by band, the
+   adaptive one needs the whole image unless the range is shared */
+static gboolean
+bands_colormapping(const ExportOptions *opts, const SharedRange *shared)
+{
+    if (shared)
+        return TRUE;
+    return (opts->colormapping == CMAP_AUTO
+            || opts->colormapping == CMAP_FULL
+            || opts->colormapping == CMAP_CLIP
+            || opts->colormapping == CMAP_EQUALIZE);
+}
+
+/** Renders and encodes the processed data of ch, over the shared range
+ *  if given
+ */
+static void
+render_channel(GwyContainer *data,
+               GwyDataField *dfield,
+               const ExportOptions *opts,
+               const SharedRange *shared,
+               ExportResult *res,
+               ExportChannelResult *ch,
+               GTimer *timer)
+{
+    GdkPixbuf *pixbuf;
+    GwyGradient *gradient;
+
+    /* Render the channel, or set it up to be rendered in bands */
+    gradient = gwy_gradients_get_gradient(opts->gradient ? opts->gradient
+                                                         : "");
+    gwy_resource_use(GWY_RESOURCE(gradient));
+
+    if (opts->band_rows > 0 && !opts->keep_pixbuf
+        && encode_rows_available(opts->format)
+        && bands_colormapping(opts, shared)) {
+        /* Keep the data to be colormapped and encoded band by band
+           when written, without the RGB image of the whole channel */
+        ch->bands = bands_new(dfield, gradient, opts, shared, ch);
+        pixbuf = NULL;
+    } else {
+        pixbuf = render_pixbuf(dfield, gradient, opts, shared, res, ch);
+    }
+
+    /* dfield is owned by the container, no reference to drop */
+    gwy_resource_release(GWY_RESOURCE(gradient));
+    ch->render_time = g_timer_elapsed(timer, NULL);
+    g_timer_start(timer);
+
+    /* Encode the GdkPixBuf in memory, bands are encoded when written */
+    if (pixbuf
+        && !encode_pixbuf(pixbuf, opts->format, &ch->image, &ch->image_size)) {
+        g_set_error(&ch->error, EXPORT_ERROR, EXPORT_ERROR_ENCODE,
+                    "Cannot encode `%s' as %s", ch->name,
+                    encode_format_name(opts->format));
+    }
+    ch->encode_time = g_timer_elapsed(timer, NULL);
+
+    if (opts->metadata) {
+        ch->metadata = build_metadata(data, res->source, opts, ch,
+                                      &ch->metadata_size);
+    }
+
+    if (opts->keep_pixbuf)
+        ch->pixbuf = pixbuf;
+    else if (pixbuf)
+        g_object_unref(pixbuf);
+}
+
+/** Processes, renders and encodes the channel `id' of data into ch
+ */
+static void
+export_channel(ExportContext *ctx,
+               GwyContainer *data,
+               const ExportOptions *opts,
+               ExportResult *res,
+               ExportChannelResult *ch,
+               gint n,
+               gint id)
+{
+    GtkWidget *view;
+    GwyPixmapLayer *layer;
+    GQuark quark;
+    gchar *basename, *s, *key;
+    const gchar *done;
+    const guchar *processed;
+    GwyDataField *dfield;
+    const SharedRange *shared = NULL;
+    GTimer *timer;
+
+    ch->id = id;
+    ch->level = -1;
+    timer = g_timer_new();
+
+    /* Data view, we hold the only reference so destroying it
+       releases the layer too */
+    view = gwy_data_view_new(data);
+    g_object_ref_sink(view);
+    /* The basic data display layer, constructed if called the
+       first time. Each GwyDataView can hold several
+       GwyDataViewLayers */
+    layer = gwy_layer_basic_new();
+
+    /* Set up the locations to display */
+    quark = gwy_app_get_data_key_for_id(id);
+    gwy_data_view_set_data_prefix(GWY_DATA_VIEW(view),
+                                  g_quark_to_string(quark));
+    gwy_pixmap_layer_set_data_key(layer, g_quark_to_string(quark));
+    gwy_data_view_set_base_layer(GWY_DATA_VIEW(view), layer);
+
+    /* There is no helper function for palette keys, set it
+       up manually */
+    if(opts->gradient) {
+      gwy_layer_basic_set_gradient_key(GWY_LAYER_BASIC(layer),
+                                       gradient_key);
+      STR_APPEND(res->chunk, ch->processing,
+                 chunk_printf(res->chunk, "Color gradient: `%s'",
+                              opts->gradient));
+    }
+    if (opts->colormapping > 0) {
+        if (opts->colormapping == CMAP_FULL) {
+            gwy_container_set_int32_by_name(data, rangetype_key,
+                                      GWY_LAYER_BASIC_RANGE_FULL);
+            gwy_layer_basic_set_range_type_key(GWY_LAYER_BASIC(layer),
+                                               rangetype_key);
+            STR_APPEND(res->chunk, ch->processing, "Color Range: Full");
+        } else if (opts->colormapping == CMAP_AUTO) {
+            gwy_container_set_int32_by_name(data, rangetype_key,
+                                      GWY_LAYER_BASIC_RANGE_AUTO);
+            gwy_layer_basic_set_range_type_key(GWY_LAYER_BASIC(layer),
+                                               rangetype_key);
+            STR_APPEND(res->chunk, ch->processing, "Color Range: Auto");
+        } else if (opts->colormapping == CMAP_ADAPTIVE) {
+            gwy_container_set_int32_by_name(data, rangetype_key,
+                                      GWY_LAYER_BASIC_RANGE_ADAPT);
+            gwy_layer_basic_set_range_type_key(GWY_LAYER_BASIC(layer),
+                                               rangetype_key);
+            STR_APPEND(res->chunk, ch->processing, "Color Range: Adaptive");
+        } else if (opts->colormapping == CMAP_CLIP) {
+            STR_APPEND(res->chunk, ch->processing,
+                       chunk_printf(res->chunk,
+                                    "Color Range: Clip (%g%%, %g%%)",
+                                    opts->clip_low, opts->clip_high));
+        } else if (opts->colormapping == CMAP_EQUALIZE) {
+            STR_APPEND(res->chunk, ch->processing, "Color Range: Equalized");
+        }
+    }
+
+    /* Select the designated data field */
+    gwy_app_data_browser_select_data_field(data, id);
+    gwy_app_data_browser_get_current(GWY_APP_DATA_FIELD, &dfield, NULL);
+    s = gwy_app_get_data_field_title(data, id);
+    ch->title = g_string_chunk_insert(res->chunk, g_strdelimit(s, " ", '_'));
+    g_free(s);
+    GC_MESSAGE(opts, "Processing channel %i : %s", id, ch->title);
+
+    basename = g_path_get_basename(res->source);
+    ch->name = chunk_printf(res->chunk, "%s-%i-%s", basename, n, ch->title);
+    g_free(basename);
+
+    /* Process the data, unless already done by a survey */
+    key = g_strdup_printf(processed_key, id);
+    if (gwy_container_gis_string_by_name(data, key, &processed)) {
+        if (*processed) {
+            STR_APPEND(res->chunk, ch->processing, (const gchar*)processed);
+        }
+    } else {
+        dfield = process_channel(ctx, data, opts, res, ch, quark, dfield,
+                                 &done);
+        if (opts->survey)
+            gwy_container_set_const_string_by_name(data, key,
+                                                    (const guchar*)done);
+    }
+    g_free(key);
+    ch->process_time = g_timer_elapsed(timer, NULL);
+    g_timer_start(timer);
+
+    /* The statistics are only measured for the metadata, where they
+       also give the full range and the histogram range. Otherwise only
+       the modes which need them get the extremes, which the data field
+       caches. The auto and adaptive ranges are Gwyddion's own, which
+       scans the data again in gwy_layer_basic_get_range() and in
+       gwy_pixbuf_draw_data_field_adaptive(). */
+    if (opts->metadata) {
+        stats_compute(dfield, &ch->stats);
+    } else if (opts->ranges
+               || opts->colormapping == CMAP_FULL
+               || opts->colormapping == CMAP_CLIP
+               || opts->colormapping == CMAP_EQUALIZE) {
+        gwy_data_field_get_min_max(dfield, &ch->stats.min, &ch->stats.max);
+    }
+    if (opts->colormapping == CMAP_FULL) {
+        ch->colormin = ch->stats.min;
+        ch->colormax = ch->stats.max;
+    } else {
+        gwy_layer_basic_get_range(GWY_LAYER_BASIC(layer),
+                                  &ch->colormin, &ch->colormax);
+    }
+    s = scalebar_auto_length(gwy_data_field_get_xreal(dfield),
+                             gwy_data_field_get_si_unit_xy(dfield),
+                             &ch->scalebar_relwidth);
+    ch->scalebar_text = g_string_chunk_insert(res->chunk, s);
+    g_free(s);
+
+    if (opts->ranges && opts->survey) {
+        /* Only measured for the ranges of the batch */
+        ranges_add(opts->ranges, dfield, opts, ch);
+    } else {
+        if (opts->ranges)
+            shared = ranges_lookup(opts->ranges, ch->title);
+        if (shared) {
+            shared_range_apply(shared, opts, ch);
+            STR_APPEND(res->chunk, ch->processing,
+                       shared_range_equalized(opts)
+                       ? "Color Range: Global, equalized"
+                       : "Color Range: Global");
+        }
+        render_channel(data, dfield, opts, shared, res, ch, timer);
+    }
+
+    g_timer_destroy(timer);
+    gtk_widget_destroy(view);
+    g_object_unref(view);
+}
+
+/** Exports the volumes of data as images of their levels into levels
+ *  or as raw stacks with their description into outputs. Levels are
+ *  only rendered and encoded when written, see export_levels_encode().
+ */
+static void
+export_volumes(GwyContainer *data,
+               const ExportOptions *opts,
+               ExportResult *res,
+               GArray *levels,
+               GArray *outputs)
+{
+    ExportChannelResult nullch = {0}, ch;
+    ExportOutput nullout = {0}, out;
+    GwyBrick *brick;
+    GwyGradient *gradient;
+    gchar *basename, *title, *name, *s, buf[16];
+    gint *ids, i, k, zres, digits;
+    gdouble min, max, relwidth;
+
+    basename = g_path_get_basename(res->source);
+    ids = gwy_app_data_browser_get_volume_ids(data);
+    for (i = 0; ids[i] != -1; i++) {
+        brick = GWY_BRICK(gwy_container_get_object(data,
+                                    gwy_app_get_brick_key_for_id(ids[i])));
+        s = gwy_app_get_brick_title(data, ids[i]);
+        title = g_string_chunk_insert(res->chunk, g_strdelimit(s, " ", '_'));
+        g_free(s);
+        GC_MESSAGE(opts, "Processing volume %i : %s", ids[i], title);
+        name = chunk_printf(res->chunk, "%s-v%i-%s", basename, i, title);
+        zres = gwy_brick_get_zres(brick);
+
+        if (opts->volumes == EXPORT_VOLUME_RAW) {
+            /* Written later level by level, keep the brick alive */
+            out = nullout;
+            out.id = ids[i];
+            out.level = -1;
+            out.title = title;
+            out.kind = "raw";
+            out.name = chunk_printf(res->chunk, "%s.raw", name);
+            out.size = (gsize)gwy_brick_get_xres(brick)
+                       *gwy_brick_get_yres(brick)*zres*sizeof(gfloat);
+            out.brick = g_object_ref(brick);
+            g_array_append_val(outputs, out);
+
+            out = nullout;
+            out.id = ids[i];
+            out.level = -1;
+            out.title = title;
+            out.kind = "txt";
+            out.name = chunk_printf(res->chunk, "%s.txt", name);
+            out.buffer = volume_describe(brick, &out.size);
+            g_array_append_val(outputs, out);
+            continue;
+        }
+
+        min = gwy_brick_get_min(brick);
+        max = gwy_brick_get_max(brick);
+        gradient = gwy_gradients_get_gradient(opts->gradient ? opts->gradient
+                                                             : "");
+        s = scalebar_auto_length(gwy_brick_get_xreal(brick),
+                                 gwy_brick_get_si_unit_x(brick), &relwidth);
+        digits = g_snprintf(buf, sizeof(buf), "%i", zres - 1);
+        for (k = 0; k < zres; k++) {
+            ch = nullch;
+            ch.id = ids[i];
+            ch.level = k;
+            ch.title = title;
+            ch.name = chunk_printf(res->chunk, "%s-%0*i", name, digits, k);
+            ch.processing = chunk_printf(res->chunk,
+                                         "Volume level %i of %i, "
+                                         "Color Range: Volume", k, zres);
+            ch.scalebar_text = g_string_chunk_insert(res->chunk, s);
+            ch.scalebar_relwidth = relwidth;
+            ch.colormin = min;
+            ch.colormax = max;
+            /* Rendered and encoded when written, see
+               export_levels_encode() */
+            ch.bands = level_bands_new(brick, k, gradient, opts, min, max);
+            g_array_append_val(levels, ch);
+        }
+        g_free(s);
+    }
+    g_free(ids);
+    g_free(basename);
+}
+
+/** Exports the curves of each graph of data as CSV or binary
+ */
+static void
+export_graphs(GwyContainer *data,
+              const ExportOptions *opts,
+              ExportResult *res,
+              GArray *outputs)
+{
+    ExportOutput nullout = {0}, out;
+    GwyGraphModel *gmodel;
+    gchar *basename, *s = NULL;
+    gint *ids, i;
+
+    basename = g_path_get_basename(res->source);
+    ids = gwy_app_data_browser_get_graph_ids(data);
+    for (i = 0; ids[i] != -1; i++) {
+        gmodel = GWY_GRAPH_MODEL(gwy_container_get_object(data,
+                                    gwy_app_get_graph_key_for_id(ids[i])));
+        out = nullout;
+        out.id = ids[i];
+        out.level = -1;
+        g_object_get(gmodel, "title", &s, NULL);
+        out.title = g_string_chunk_insert(res->chunk,
+                                          s ? g_strdelimit(s, " ", '_')
+                                            : "Graph");
+        g_free(s);
+        GC_MESSAGE(opts, "Processing graph %i : %s", ids[i], out.title);
+        if (opts->graphs == EXPORT_GRAPH_CSV) {
+            out.kind = "csv";
+            out.buffer = graph_to_csv(gmodel, &out.size);
+        } else {
+            out.kind = "bin";
+            out.buffer = graph_to_binary(gmodel, &out.size);
+        }
+        out.name = chunk_printf(res->chunk, "%s-g%i-%s.%s", basename, i,
+                                out.title, out.kind);
+        g_array_append_val(outputs, out);
+    }
+    g_free(ids);
+    g_free(basename);
+}
+
+/* Writes the processed data of a survey to a new file of the cache
+   directory, with the container serialized as in .gwy files. Volumes
+   and graphs are dropped first unless they are exported. */
+static gboolean
+write_cache(GwyContainer *data,
+            const ExportOptions *opts,
+            ExportResult *res,
+            GError **error)
+{
+    GByteArray *buffer;
+    GError *err = NULL;
+    gchar *name, *path;
+    gboolean ok;
+
+    if (!opts->volumes)
+        gwy_container_remove_by_prefix(data, "/brick");
+    if (!opts->graphs)
+        gwy_container_remove_by_prefix(data, "/0/graph/graph");
+
+    name = g_strdup_printf("%06u.gwycache", opts->ranges->n_cached++);
+    path = g_build_filename(opts->cache_dir ? opts->cache_dir
+                                            : g_get_tmp_dir(), name, NULL);
+    g_free(name);
+    buffer = gwy_serializable_serialize(G_OBJECT(data), NULL);
+    ok = g_file_set_contents(path, (const gchar*)buffer->data, buffer->len,
+                             &err);
+    g_byte_array_free(buffer, TRUE);
+    if (ok) {
+        res->cache = g_string_chunk_insert(res->chunk, path);
+    } else {
+        g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_CACHE,
+                    "Cannot cache `%s': %s", res->source, err->message);
+        g_clear_error(&err);
+    }
+    g_free(path);
+    return ok;
+}
+
+/**
+ * export_container:
+ * @ctx: An export context.
+ * @data: The loaded file, it must not be in the data browser already.
+ * @source: The file name the outputs are named after.
+ * @options: The export options, with ranges to survey into if
+ *           survey is set.
+ * @result: Location to store the result, to be cleared with
+ *          export_result_clear().
+ * @error: Location to store the error, or %NULL.
+ *
+ * Exports all the channels of a file which is already loaded, and
+ * its volumes and graphs if requested. The channels are processed in
+ * place, pass a duplicate to keep @data.
+ *
+ * Returns: Whether the file could be exported. Errors of single
+ *          channels are set in their results.
+ */
+gboolean
+export_container(ExportContext *ctx,
+                 GwyContainer *data,
+                 const gchar *source,
+                 const ExportOptions *options,
+                 ExportResult *result,
+                 GError **error)
+{
+    ExportResult null = {0};
+    GArray *levels, *outputs;
+    gint *ids;
+    gint i;
+
+    *result = null;
+    if (options->survey && !options->ranges) {
+        g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_CACHE,
+                    "Cannot survey `%s' without ranges to record", source);
+        return FALSE;
+    }
+    result->chunk = g_string_chunk_new(256);
+    result->source = g_string_chunk_insert(result->chunk, source);
+
+    /* Register data to the data browser to be able to use
+     * gwy_app_data_browser_get_data_ids() */
+    gwy_app_data_browser_add(data);
+    /* But do not let it manage our file */
+    gwy_app_data_browser_set_keep_invisible(data, TRUE);
+
+    /* Obtain the list of channel numbers and check whether
+       there are any */
+    ids = gwy_app_data_browser_get_data_ids(data);
+    for (result->n_channels = 0;
+         ids[result->n_channels] != -1; result->n_channels++)
+        ;
+    if (result->n_channels <= 0) {
+        GC_WARNING(options, "File `%s' contains no channels to export\n",
+                   source);
+    }
+
+    /* Iterate all channels */
+    result->channels = g_new0(ExportChannelResult, result->n_channels);
+    for (i = 0; i < result->n_channels; ++i) {
+        export_channel(ctx, data, options, result,
+                       result->channels + i, i, ids[i]);
+    }
+    g_free(ids);
+
+    /* Volumes and graphs wait for the export of the cache */
+    levels = g_array_new(FALSE, FALSE, sizeof(ExportChannelResult));
+    outputs = g_array_new(FALSE, FALSE, sizeof(ExportOutput));
+    if (options->volumes && !options->survey)
+        export_volumes(data, options, result, levels, outputs);
+    if (options->graphs && !options->survey)
+        export_graphs(data, options, result, outputs);
+    result->n_levels = levels->len;
+    result->levels = (ExportChannelResult*)g_array_free(levels, FALSE);
+    result->n_outputs = outputs->len;
+    result->outputs = (ExportOutput*)g_array_free(outputs, FALSE);
+
+    gwy_app_data_browser_remove(data);
+
+    if (options->survey && !write_cache(data, options, result, error)) {
+        export_result_clear(result);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * export_file:
+ * @ctx: An export context.
+ * @path: The file to export.
+ * @options: The export options.
+ * @result: Location to store the result, to be cleared with
+ *          export_result_clear() if the export succeeded.
+ * @error: Location to store the error, or %NULL.
+ *
+ * Loads a file and exports all its channels.
+ *
+ * Returns: Whether the file could be loaded and exported.
+ */
+gboolean
+export_file(ExportContext *ctx,
+            const gchar *path,
+            const ExportOptions *options,
+            ExportResult *result,
+            GError **error)
+{
+    GwyContainer *data;
+    GError *err = NULL;
+    GTimer *timer;
+    gdouble t;
+    gboolean ok;
+
+    /* Load the file */
+    timer = g_timer_new();
+    data = gwy_file_load(path, GWY_RUN_NONINTERACTIVE, &err);
+    t = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    if (!data) {
+        g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_LOAD,
+                    "Cannot load `%s': %s", path,
+                    err ? err->message : "unknown error");
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    ok = export_container(ctx, data, path, options, result, error);
+    if (ok)
+        result->load_time = t;
+    g_object_unref(data);
+    return ok;
+}
+
+/**
+ * export_cache:
+ * @ctx: An export context.
+ * @cache: A file written by a survey, ExportResult.cache.
+ * @source: Path of the file the cache was written for.
+ * @options: Export options, with the ranges of the survey.
+ * @result: Location to store the result, clear with export_result_clear().
+ * @error: Location to store the error.
+ *
+ * Exports the processed data cached by a survey, without loading and
+ * filtering the source again.
+ *
+ * Returns: Whether the cache could be read.
+ */
+gboolean
+export_cache(ExportContext *ctx,
+             const gchar *cache,
+             const gchar *source,
+             const ExportOptions *options,
+             ExportResult *result,
+             GError **error)
+{
+    GObject *object;
+    GError *err = NULL;
+    GTimer *timer;
+    gchar *buffer;
+    gsize size, pos = 0;
+    gdouble t;
+    gboolean ok;
+
+    timer = g_timer_new();
+    if (!g_file_get_contents(cache, &buffer, &size, &err)) {
+        g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_CACHE,
+                    "Cannot read the cache of `%s': %s", source,
+                    err->message);
+        g_clear_error(&err);
+        g_timer_destroy(timer);
+        return FALSE;
+    }
+    object = gwy_serializable_deserialize((const guchar*)buffer, size, &pos);
+    g_free(buffer);
+    t = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    if (!object || !GWY_IS_CONTAINER(object)) {
+        g_set_error(error, EXPORT_ERROR, EXPORT_ERROR_CACHE,
+                    "Invalid cache of `%s'", source);
+        if (object)
+            g_object_unref(object);
+        return FALSE;
+    }
+
+    ok = export_container(ctx, GWY_CONTAINER(object), source, options,
+                          result, error);
+    if (ok)
+        result->load_time = t;
+    g_object_unref(object);
+    return ok;
+}
+
+static void
+channel_result_clear(ExportChannelResult *ch)
+{
+    if (ch->pixbuf)
+        g_object_unref(ch->pixbuf);
+    g_free(ch->image);
+    g_free(ch->metadata);
+    if (ch->bands)
+        bands_free(ch->bands);
+    g_clear_error(&ch->error);
+}
+
+/**
+ * export_channel_encode:
+ * @channel: A channel of a result.
+ *
+ * Encodes a channel kept in bands into channel->image, band by band,
+ * for outputs which need the size before the data. Channels which are
+ * already encoded are left as they are.
+ *
+ * Returns: Whether channel->image is set, channel->error is set if not.
+ */
+gboolean
+export_channel_encode(ExportChannelResult *channel)
+{
+    GTimer *timer;
+
+    if (channel->image || !channel->bands)
+        return channel->image != NULL;
+
+    timer = g_timer_new();
+    if (!bands_encode(channel->bands, NULL,
+                      &channel->image, &channel->image_size)) {
+        g_set_error(&channel->error, EXPORT_ERROR, EXPORT_ERROR_ENCODE,
+                    "Cannot encode `%s' as %s", channel->name,
+                    encode_format_name(channel->bands->format));
+    }
+    channel->encode_time = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    return channel->image != NULL;
+}
+
+/* Encodes the levels [from, to) of the result held by user_data */
+static void
+encode_level_block(gpointer user_data, gint from, gint to)
+{
+    ExportChannelResult *levels = (ExportChannelResult*)user_data;
+    gint i;
+
+    for (i = from; i < to; i++)
+        export_channel_encode(levels + i);
+}
+
+/**
+ * export_levels_encode:
+ * @result: A result.
+ * @from: The first level to encode.
+ * @n: The number of levels to encode.
+ *
+ * Renders and encodes n volume levels of the result into their image,
+ * in parallel on all processors. Writing a volume window by window
+ * keeps only the encoded images of one window in memory.
+ */
+void
+export_levels_encode(ExportResult *result, gint from, gint n)
+{
+    n = MIN(n, result->n_levels - from);
+    if (n > 0)
+        run_row_blocks(encode_level_block, result->levels + from, n);
+}
+
+/* Releases everything held by a result */
+void
+export_result_clear(ExportResult *result)
+{
+    ExportResult null = {0};
+    gint i;
+
+    for (i = 0; i < result->n_channels; ++i)
+        channel_result_clear(result->channels + i);
+    for (i = 0; i < result->n_levels; ++i)
+        channel_result_clear(result->levels + i);
+    for (i = 0; i < result->n_outputs; ++i) {
+        g_free(result->outputs[i].buffer);
+        if (result->outputs[i].brick)
+            g_object_unref(result->outputs[i].brick);
+    }
+    g_free(result->channels);
+    g_free(result->levels);
+    g_free(result->outputs);
+    if (result->chunk)
+        g_string_chunk_free(result->chunk);
+    *result = null;
+}
+
+/**
+ * export_output_write:
+ * @output: An output of a result.
+ * @fp: The file to write to.
+ *
+ * Writes the buffer of the output, its volume as a raw stack one
+ * level after another or its channel encoded band by band.
+ *
+ * Returns: Whether all output->size bytes could be written, or the
+ *          whole volume or channel.
+ */
+gboolean
+export_output_write(const ExportOutput *output, FILE *fp)
+{
+    if (output->bands)
+        return bands_encode(output->bands, fp, NULL, NULL);
+    if (output->brick)
+        return volume_write_raw(output->brick, fp);
+    return fwrite(output->buffer, 1, output->size, fp) == output->size;
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
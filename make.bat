@@ -1,2 +1,9 @@
 gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o gwyexport.o -c gwyexport.c
-gcc -L c:\MinGW\bin -L c:\MinGW\lib -L c:\msys\1.0\local\lib -L c:\msys\1.0\local\lib\gwyddion -o gwyexport.exe gwyexport.o -lgwyddion2  -lgwyapp2 -lgwymodule2 -lgwyprocess2 -lgwydraw2 -lgdk_pixbuf-2.0-0 -lgwydgets2 -lgtk-win32-2.0 -lglib-2.0 -lgobject-2.0
\ No newline at end of file
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o libgwyexport.o -c libgwyexport.c
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o filters.o -c filters.c
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o colormap.o -c colormap.c
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o encode.o -c encode.c
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o volume.o -c volume.c
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o graph.o -c graph.c
+gcc  -I c:\MinGW\include\gtk-2.0\  -I c:\MinGW\include\glib-2.0\  -I c:\MinGW\lib\glib-2.0\include  -I c:\MinGW\lib\gtk-2.0\include  -I c:\MinGW\include\cairo  -I c:\MinGW\include\pango-1.0  -I c:\MinGW\include\  -I c:\MinGW\include\atk-1.0 -I c:\MinGW\include\gdk-pixbuf-2.0\ -I C:\msys\1.0\local\lib -I C:\msys\1.0\local\lib\gwyddion -I C:\MinGW\include\gwyddion -I C:\gwyddion -mms-bitfields  -o stats.o -c stats.c
+gcc -L c:\MinGW\bin -L c:\MinGW\lib -L c:\msys\1.0\local\lib -L c:\msys\1.0\local\lib\gwyddion -o gwyexport.exe gwyexport.o libgwyexport.o filters.o colormap.o encode.o volume.o graph.o stats.o -lgwyddion2  -lgwyapp2 -lgwymodule2 -lgwyprocess2 -lgwydraw2 -lgdk_pixbuf-2.0-0 -lgwydgets2 -lgtk-win32-2.0 -lglib-2.0 -lgobject-2.0
\ No newline at end of file
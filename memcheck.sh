@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+#  memcheck.sh
+#  Copyright © 2012 François Bianco
+#  Email: francois.bianco@unige.ch
+#
+#  This code is available under the GPL v3 or any later version
+#
+#  Checks that the memory of gwyexport stays flat over a long batch.
+#  A short and a long batch of synthetic scans are exported under
+#  valgrind, once with memcheck and once with massif. The bytes
+#  definitely and indirectly lost and the peak heap must not grow from
+#  the short batch to the long one, so whatever leaks or accumulates
+#  per file fails the check, while the one-off allocations of Gtk+ and
+#  Gwyddion do not.
+#
+#    ./memcheck.sh [short] [long]
+#
+#  The batches have `short' (default 10) and `long' (default 100)
+#  files. LEAK_SLACK and HEAP_SLACK set the growth allowed in bytes,
+#  MEMCHECK_ARGS the options of gwyexport. Everything goes to
+#  memcheck-work.
+#
+
+set -e
+
+SHORT=${1:-10}
+LONG=${2:-100}
+WORK=memcheck-work
+MAKE=${MAKE:-make}
+VALGRIND=${VALGRIND:-valgrind}
+LEAK_SLACK=${LEAK_SLACK:-1024}
+HEAP_SLACK=${HEAP_SLACK:-1048576}
+MEMCHECK_ARGS=${MEMCHECK_ARGS:--s -m -f png -c adaptive --defaultfilters}
+
+. ./scan.sh
+
+# GLib allocates through malloc, so valgrind sees every block
+G_SLICE=always-malloc
+G_DEBUG=gc-friendly
+export G_SLICE G_DEBUG
+
+# Fills the directory $1 with $2 copies of the scans
+make_batch() {
+    mkdir -p "$1"
+    i=0
+    while [ $i -lt "$2" ]; do
+        cp "$WORK/scan$((i % 4)).sdf" "$1/file$i.sdf"
+        i=$((i + 1))
+    done
+}
+
+# Exports the batch $1 into $1-out under valgrind with the tool $2 and
+# its options, the log goes to $1-$2.log
+run_batch() {
+    batch=$1
+    tool=$2
+    shift 2
+    rm -rf "$batch-out"
+    mkdir -p "$batch-out"
+    # word splitting of MEMCHECK_ARGS is intended
+    $VALGRIND --tool="$tool" --log-file="$batch-$tool.log" "$@" \
+        ./gwyexport $MEMCHECK_ARGS -o "$batch-out" "$batch"/*.sdf \
+        > /dev/null
+}
+
+# Prints the bytes definitely and indirectly lost of a memcheck log
+leaked() {
+    awk '/definitely lost:|indirectly lost:/ {
+        gsub(",", "", $4)
+        n += $4
+    } END { print n + 0 }' "$1"
+}
+
+# Prints the peak heap in bytes of a massif output
+peak_heap() {
+    awk -F= '/^mem_heap_B=/ { if ($2 + 0 > m) m = $2 + 0 } END {
+        print m + 0
+    }' "$1"
+}
+
+if ! command -v "$VALGRIND" > /dev/null; then
+    echo "memcheck.sh: $VALGRIND not found" >&2
+    exit 1
+fi
+
+$MAKE all
+rm -rf "$WORK"
+mkdir -p "$WORK"
+make_scan "$WORK/scan0.sdf" 128 128 1
+make_scan "$WORK/scan1.sdf" 256 128 2
+make_scan "$WORK/scan2.sdf" 128 256 3
+make_scan "$WORK/scan3.sdf" 200 200 4
+make_batch "$WORK/short" "$SHORT"
+make_batch "$WORK/long" "$LONG"
+
+for b in short long; do
+    run_batch "$WORK/$b" memcheck --leak-check=full
+    run_batch "$WORK/$b" massif --massif-out-file="$WORK/$b.massif"
+done
+
+leak_short=$(leaked "$WORK/short-memcheck.log")
+leak_long=$(leaked "$WORK/long-memcheck.log")
+heap_short=$(peak_heap "$WORK/short.massif")
+heap_long=$(peak_heap "$WORK/long.massif")
+
+awk -v s="$SHORT" -v l="$LONG" -v ls="$leak_short" -v ll="$leak_long" \
+    -v hs="$heap_short" -v hl="$heap_long" 'BEGIN {
+    printf "Batch of          %10d %10d files\n", s, l
+    printf "Lost              %10d %10d bytes\n", ls, ll
+    printf "Peak heap         %10d %10d bytes\n", hs, hl
+}'
+
+status=0
+if [ $((leak_long - leak_short)) -gt "$LEAK_SLACK" ]; then
+    echo "memcheck.sh: leaks grow with the batch, see" \
+         "$WORK/long-memcheck.log" >&2
+    status=1
+fi
+if [ $((heap_long - heap_short)) -gt "$HEAP_SLACK" ]; then
+    echo "memcheck.sh: the peak heap grows with the batch, see" \
+         "$WORK/long.massif" >&2
+    status=1
+fi
+if [ $status -eq 0 ]; then
+    echo "Memory stays flat over the batch."
+fi
+exit $status
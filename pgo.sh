@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+#  pgo.sh
+#  Copyright © 2012 François Bianco
+#  Email: francois.bianco@unige.ch
+#
+#  This code is available under the GPL v3 or any later version
+#
+#  Profile-guided release build of gwyexport. Builds a reference binary
+#  with the default flags, a release binary, an instrumented one which
+#  is trained on a synthetic workload, and the final binary from that
+#  profile. The outputs of the release binaries are checked against the
+#  golden outputs of the reference one and the speedups are reported.
+#
+#    ./pgo.sh [runs]
+#
+#  The workload is timed as the best of `runs' (default 3). The final
+#  binary is left as ./gwyexport, everything else goes to pgo-work. Any
+#  file failing to export stops the script.
+#
+
+set -e
+
+RUNS=${1:-3}
+WORK=pgo-work
+MAKE=${MAKE:-make}
+
+. ./scan.sh
+
+# Exports the corpus with a mix of filters, colormaps and formats into
+# the directory $2 with the binary $1
+workload() {
+    rm -rf "$2"
+    mkdir -p "$2/a" "$2/b" "$2/c" "$2/d" "$2/e"
+    "$1" -s -f png -c auto --defaultfilters \
+        -o "$2/a" "$WORK"/corpus/*.sdf > /dev/null
+    "$1" -s -f jpg -c clip:1,99 --filters 'pc;melc;gauss:2;pc' \
+        -o "$2/b" "$WORK"/corpus/*.sdf > /dev/null
+    "$1" -s -f qoi -c equalize --filters 'pc;median:5;sr' \
+        -o "$2/c" "$WORK"/corpus/*.sdf > /dev/null
+    "$1" -s -f png -c full --filters 'pc;highpass:0.05' --max-size 256 \
+        -o "$2/d" "$WORK"/corpus/*.sdf > /dev/null
+    "$1" -s -f png -c equalize --filters 'pc;melc' --bands 64 \
+        -o "$2/e" "$WORK"/corpus/*.sdf > /dev/null
+}
+
+# Prints the wall-clock time in seconds. `date +%N' is a GNU extension,
+# elsewhere perl is used if found, or whole seconds.
+now() {
+    t=$(date +%s.%N)
+    case $t in
+    *N)
+        if command -v perl > /dev/null; then
+            perl -MTime::HiRes=time -e 'printf "%.6f\n", time'
+        else
+            date +%s
+        fi
+        ;;
+    *)
+        echo "$t"
+        ;;
+    esac
+}
+
+# Prints the best wall-clock time of the workload in seconds
+timed_workload() {
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        t0=$(now)
+        workload "$1" "$2"
+        t1=$(now)
+        best=$(awk -v a="$t0" -v b="$t1" -v best="$best" 'BEGIN {
+            t = b - a
+            if (best == "" || t < best) print t; else print best
+        }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+# Fails unless the outputs match the golden ones, journals aside
+check_outputs() {
+    if ! diff -r -q -x .gwyexport-journal "$WORK/golden" "$1"; then
+        echo "pgo.sh: outputs of $2 differ from the golden outputs" >&2
+        exit 1
+    fi
+}
+
+# Reference build and golden outputs, `make clean' also removes $WORK
+$MAKE clean
+$MAKE all
+mkdir -p "$WORK/corpus"
+make_scan "$WORK/corpus/scan1.sdf" 512 512 1
+make_scan "$WORK/corpus/scan2.sdf" 512 512 2
+make_scan "$WORK/corpus/scan3.sdf" 1024 256 3
+make_scan "$WORK/corpus/scan4.sdf" 1024 1024 4
+cp gwyexport "$WORK/gwyexport-reference"
+t_ref=$(timed_workload "$WORK/gwyexport-reference" "$WORK/golden")
+
+# Release build without profile
+$MAKE release
+cp gwyexport "$WORK/gwyexport-release"
+t_rel=$(timed_workload "$WORK/gwyexport-release" "$WORK/release")
+check_outputs "$WORK/release" "the release build"
+
+# Training run of the instrumented build, then the final build
+$MAKE pgo-instrument
+workload ./gwyexport "$WORK/train"
+$MAKE pgo-use
+t_pgo=$(timed_workload ./gwyexport "$WORK/pgo")
+check_outputs "$WORK/pgo" "the profile-guided build"
+
+awk -v ref="$t_ref" -v rel="$t_rel" -v pgo="$t_pgo" -v runs="$RUNS" 'BEGIN {
+    printf "Workload times, best of %d runs:\n", runs
+    printf "  reference (-O2)   %8.3f s\n", ref
+    printf "  release (-O3 LTO) %8.3f s  speedup %.2fx\n", rel, ref/rel
+    printf "  profile-guided    %8.3f s  speedup %.2fx\n", pgo, ref/pgo
+    printf "Outputs match the golden outputs.\n"
+}'
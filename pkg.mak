@@ -4,10 +4,14 @@ PACKAGE = gwyexport
 # Module version, it is also defined as a preprocessor macro you are
 # encouraged to use for module registering.
 VERSION = 1.1
+# Source files of the libgwyexport library
+LIB_SOURCES = libgwyexport.c filters.c colormap.c encode.c volume.c graph.c stats.c
+# Public header files of the library
+LIB_HEADERS = gwyexport.h encode.h stats.h
 # Module source files
-SOURCES = gwyexport.c
+SOURCES = gwyexport.c $(LIB_SOURCES)
 # Module header files, if any
-HEADERS =
+HEADERS = $(LIB_HEADERS) private.h filters.h colormap.h volume.h graph.h
 # Extra files to distribute (README, ...)
 EXTRA_DIST =
 
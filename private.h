@@ -0,0 +1,35 @@
+/*
+ *  private.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Definitions shared by the gwyexport tool and libgwyexport which are
+ *  not part of the library interface
+ *
+ */
+
+#ifndef __GWYEXPORT_PRIVATE_H__
+#define __GWYEXPORT_PRIVATE_H__
+
+#include <glib.h>
+
+#define EXPORT_DEFAULT_FILTERLIST "pc;melc;sr;melc;pc"
+#define EXPORT_FILTER_DELIMITER ";"
+
+/* Messages, unless silent, of anything with a `silentmode' member */
+#define GC_MESSAGE(gp, s, ...) \
+    do { \
+        if (!(gp)->silentmode) \
+            g_message(s, ##__VA_ARGS__); \
+    } while (0)
+#define GC_WARNING(gp, s, ...) \
+    do { \
+        if (!(gp)->silentmode) \
+            g_warning(s, ##__VA_ARGS__); \
+    } while (0)
+
+#endif /* __GWYEXPORT_PRIVATE_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
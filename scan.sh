@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+#  scan.sh
+#  Copyright © 2012 François Bianco
+#  Email: francois.bianco@unige.ch
+#
+#  This code is available under the GPL v3 or any later version
+#
+#  Synthetic scans for the workloads of pgo.sh and memcheck.sh, to be
+#  sourced by them
+#
+#    make_scan <file> <xres> <yres> <seed>
+#
+
+# Writes a synthetic scan as a text Surface Data File: a tilted plane
+# with bumps, line offsets, a few scars and noise, so all the default
+# filters have something to correct.
+make_scan() {
+    awk -v xres="$2" -v yres="$3" -v seed="$4" 'BEGIN {
+        srand(seed)
+        printf "aBCR-1.0\n"
+        printf "ManufacID   = gwyexport\n"
+        printf "CreateDate  = 010120120000\n"
+        printf "ModDate     = 010120120000\n"
+        printf "NumPoints   = %d\n", xres
+        printf "NumProfiles = %d\n", yres
+        printf "Xscale      = 1.0e-9\n"
+        printf "Yscale      = 1.0e-9\n"
+        printf "Zscale      = 1.0e-12\n"
+        printf "Zresolution = -1\n"
+        printf "Compression = 0\n"
+        printf "DataType    = 6\n"
+        printf "CheckType   = 0\n"
+        printf "*\n"
+        nb = 40
+        for (k = 0; k < nb; k++) {
+            bx[k] = rand()*xres; by[k] = rand()*yres
+            bw[k] = 4 + rand()*xres/16; bh[k] = 200 + rand()*2000
+        }
+        for (i = 0; i < yres; i++) {
+            offset = (rand() - 0.5)*400
+            scar = (rand() < 0.01)
+            na = 0
+            for (k = 0; k < nb; k++) {
+                if ((i - by[k])^2 < 9*bw[k]*bw[k])
+                    act[na++] = k
+            }
+            for (j = 0; j < xres; j++) {
+                z = 3*j + 2*i + offset + (rand() - 0.5)*60
+                for (a = 0; a < na; a++) {
+                    k = act[a]
+                    r2 = ((j - bx[k])^2 + (i - by[k])^2)/(bw[k]*bw[k])
+                    if (r2 < 9)
+                        z += bh[k]*exp(-r2)
+                }
+                if (scar && j > xres/4 && j < 3*xres/4)
+                    z += 1500
+                printf "%d\n", z
+            }
+        }
+        printf "*\n"
+    }' > "$1"
+}
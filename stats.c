@@ -0,0 +1,166 @@
+/*
+ *  stats.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Statistics of the processed channels of gwyexport. The extremes and
+ *  the first three moments come from a single pass over the rows on
+ *  all processors, accumulated in independent lanes which the compiler
+ *  keeps in vector registers. Ra takes a second pass, as it needs the
+ *  mean first.
+ *
+ */
+
+#include <math.h>
+#include <glib.h>
+
+#include <libgwyddion/gwyddion.h>
+#include <libprocess/gwyprocess.h>
+
+#include "stats.h"
+#include "filters.h"
+
+/* Independent accumulators of the inner loops */
+#define STATS_LANES 4
+
+typedef struct {
+    const gdouble *data;
+    gint xres;
+    /* Values are accumulated relative to it, against cancellation */
+    gdouble shift;
+    /* Totals of the blocks */
+    GMutex lock;
+    gdouble min;
+    gdouble max;
+    gdouble s1;
+    gdouble s2;
+    gdouble s3;
+    gdouble sa;
+} StatsData;
+
+/* Extremes and the sums of the first three powers of rows [from, to) */
+static void
+stats_rows(gpointer user_data, gint from, gint to)
+{
+    StatsData *sd = (StatsData*)user_data;
+    const gdouble *d = sd->data + (gsize)from*sd->xres;
+    gsize i, n = (gsize)(to - from)*sd->xres;
+    gdouble mn[STATS_LANES], mx[STATS_LANES];
+    gdouble s1[STATS_LANES], s2[STATS_LANES], s3[STATS_LANES];
+    gdouble z, min, max, t1, t2, t3;
+    gint k;
+
+    for (k = 0; k < STATS_LANES; k++) {
+        mn[k] = mx[k] = d[0] - sd->shift;
+        s1[k] = s2[k] = s3[k] = 0.0;
+    }
+    for (i = 0; i + STATS_LANES <= n; i += STATS_LANES) {
+        for (k = 0; k < STATS_LANES; k++) {
+            z = d[i + k] - sd->shift;
+            mn[k] = z < mn[k] ? z : mn[k];
+            mx[k] = z > mx[k] ? z : mx[k];
+            s1[k] += z;
+            s2[k] += z*z;
+            s3[k] += z*z*z;
+        }
+    }
+    for (k = 0; i < n; i++, k++) {
+        z = d[i] - sd->shift;
+        mn[k] = z < mn[k] ? z : mn[k];
+        mx[k] = z > mx[k] ? z : mx[k];
+        s1[k] += z;
+        s2[k] += z*z;
+        s3[k] += z*z*z;
+    }
+
+    min = mn[0];
+    max = mx[0];
+    t1 = t2 = t3 = 0.0;
+    for (k = 0; k < STATS_LANES; k++) {
+        min = MIN(min, mn[k]);
+        max = MAX(max, mx[k]);
+        t1 += s1[k];
+        t2 += s2[k];
+        t3 += s3[k];
+    }
+
+    g_mutex_lock(&sd->lock);
+    sd->min = MIN(sd->min, min);
+    sd->max = MAX(sd->max, max);
+    sd->s1 += t1;
+    sd->s2 += t2;
+    sd->s3 += t3;
+    g_mutex_unlock(&sd->lock);
+}
+
+/* Sum of the absolute deviations from the mean, which sd->shift holds
+   by then */
+static void
+stats_abs_rows(gpointer user_data, gint from, gint to)
+{
+    StatsData *sd = (StatsData*)user_data;
+    const gdouble *d = sd->data + (gsize)from*sd->xres;
+    gsize i, n = (gsize)(to - from)*sd->xres;
+    gdouble sa[STATS_LANES], t;
+    gint k;
+
+    for (k = 0; k < STATS_LANES; k++)
+        sa[k] = 0.0;
+    for (i = 0; i + STATS_LANES <= n; i += STATS_LANES) {
+        for (k = 0; k < STATS_LANES; k++)
+            sa[k] += fabs(d[i + k] - sd->shift);
+    }
+    for (; i < n; i++)
+        sa[0] += fabs(d[i] - sd->shift);
+
+    t = 0.0;
+    for (k = 0; k < STATS_LANES; k++)
+        t += sa[k];
+
+    g_mutex_lock(&sd->lock);
+    sd->sa += t;
+    g_mutex_unlock(&sd->lock);
+}
+
+/**
+ * stats_compute:
+ * @dfield: A data field.
+ * @stats: Location to store the statistics.
+ *
+ * Computes the extremes, mean, Rq, Ra and skew of a data field. All
+ * but Ra come from one pass over the data. Ra needs the mean, so it
+ * takes a second pass which only sums absolute values.
+ */
+void
+stats_compute(GwyDataField *dfield, ChannelStats *stats)
+{
+    StatsData sd;
+    gdouble n, m1, m2, m3;
+
+    sd.xres = gwy_data_field_get_xres(dfield);
+    sd.data = gwy_data_field_get_data_const(dfield);
+    sd.shift = sd.data[0];
+    sd.min = sd.max = 0.0;
+    sd.s1 = sd.s2 = sd.s3 = sd.sa = 0.0;
+    g_mutex_init(&sd.lock);
+    run_row_blocks(stats_rows, &sd, gwy_data_field_get_yres(dfield));
+
+    n = (gdouble)sd.xres*gwy_data_field_get_yres(dfield);
+    m1 = sd.s1/n;
+    m2 = MAX(sd.s2/n - m1*m1, 0.0);
+    m3 = sd.s3/n - 3.0*m1*sd.s2/n + 2.0*m1*m1*m1;
+    stats->min = sd.shift + sd.min;
+    stats->max = sd.shift + sd.max;
+    stats->mean = sd.shift + m1;
+    stats->rq = sqrt(m2);
+    stats->skew = m2 > 0.0 ? m3/(m2*stats->rq) : 0.0;
+
+    sd.shift = stats->mean;
+    run_row_blocks(stats_abs_rows, &sd, gwy_data_field_get_yres(dfield));
+    stats->ra = sd.sa/n;
+    g_mutex_clear(&sd.lock);
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
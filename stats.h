@@ -0,0 +1,34 @@
+/*
+ *  stats.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Statistics of the processed channels of gwyexport, computed on all
+ *  processors in one pass over the rows, and a second one for Ra
+ *
+ */
+
+#ifndef __GWYEXPORT_STATS_H__
+#define __GWYEXPORT_STATS_H__
+
+#include <libprocess/gwyprocess.h>
+
+/* In the value units of the data field, except the skew */
+typedef struct {
+    gdouble min;
+    gdouble max;
+    gdouble mean;
+    /* Root mean square and mean absolute deviations from the mean */
+    gdouble rq;
+    gdouble ra;
+    gdouble skew;
+} ChannelStats;
+
+void stats_compute (GwyDataField *dfield,
+                    ChannelStats *stats);
+
+#endif /* __GWYEXPORT_STATS_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
@@ -0,0 +1,139 @@
+/*
+ *  volume.c
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Export of volume data level by level, as images or a raw stack.
+ *  The levels of a brick are contiguous planes, so each one is read in
+ *  place and the brick is never copied as a whole.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <libgwyddion/gwyddion.h>
+#include <libprocess/gwyprocess.h>
+
+#include "volume.h"
+
+/* Levels converted to floats at once when writing a raw stack */
+#define RAW_BLOCK 65536
+
+/**
+ * volume_level_new:
+ * @brick: A volume data brick.
+ * @level: The level to copy.
+ *
+ * Copies a level of the brick into a data field, which levels exported
+ * as images are rendered from one at a time.
+ *
+ * Returns: A new data field of the size of the level.
+ */
+GwyDataField*
+volume_level_new(GwyBrick *brick, gint level)
+{
+    GwyDataField *dfield;
+    gint xres, yres;
+
+    xres = gwy_brick_get_xres(brick);
+    yres = gwy_brick_get_yres(brick);
+    dfield = gwy_data_field_new(xres, yres,
+                                gwy_brick_get_xreal(brick),
+                                gwy_brick_get_yreal(brick), FALSE);
+    memcpy(gwy_data_field_get_data(dfield),
+           gwy_brick_get_data_const(brick) + (gsize)level*xres*yres,
+           (gsize)xres*yres*sizeof(gdouble));
+    gwy_data_field_invalidate(dfield);
+    return dfield;
+}
+
+/**
+ * volume_write_raw:
+ * @brick: A volume data brick.
+ * @fp: The file to write to.
+ *
+ * Writes the brick as little endian 32 bit floats, x fastest, then y,
+ * then the level. Only a block of each level is converted at once.
+ *
+ * Returns: Whether all data could be written.
+ */
+gboolean
+volume_write_raw(GwyBrick *brick, FILE *fp)
+{
+    const gdouble *d;
+    union { gfloat f; guint32 i; } *block;
+    gsize n, i, j, m;
+
+    n = (gsize)gwy_brick_get_xres(brick)*gwy_brick_get_yres(brick)
+        *gwy_brick_get_zres(brick);
+    d = gwy_brick_get_data_const(brick);
+    block = g_malloc(RAW_BLOCK*sizeof(*block));
+
+    for (i = 0; i < n; i += m) {
+        m = MIN(n - i, RAW_BLOCK);
+        for (j = 0; j < m; j++) {
+            block[j].f = (gfloat)d[i + j];
+            block[j].i = GUINT32_TO_LE(block[j].i);
+        }
+        if (fwrite(block, sizeof(*block), m, fp) != m) {
+            g_free(block);
+            return FALSE;
+        }
+    }
+
+    g_free(block);
+    return TRUE;
+}
+
+static void
+append_unit(GString *text, const gchar *key, GwySIUnit *unit)
+{
+    gchar *s = gwy_si_unit_get_string(unit, GWY_SI_UNIT_FORMAT_PLAIN);
+
+    g_string_append_printf(text, "%s=%s\n", key, s);
+    g_free(s);
+}
+
+/**
+ * volume_describe:
+ * @brick: A volume data brick.
+ * @size: Location to store the length of the text.
+ *
+ * Describes the layout of the raw stack of volume_write_raw() as
+ * `key=value' lines.
+ *
+ * Returns: A newly allocated text.
+ */
+gchar*
+volume_describe(GwyBrick *brick, gsize *size)
+{
+    GString *text;
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+    text = g_string_new("type=float32le\n");
+    g_string_append_printf(text, "xres=%i\n", gwy_brick_get_xres(brick));
+    g_string_append_printf(text, "yres=%i\n", gwy_brick_get_yres(brick));
+    g_string_append_printf(text, "zres=%i\n", gwy_brick_get_zres(brick));
+    g_string_append_printf(text, "xreal=%s\n",
+                           g_ascii_dtostr(buf, sizeof(buf),
+                                          gwy_brick_get_xreal(brick)));
+    g_string_append_printf(text, "yreal=%s\n",
+                           g_ascii_dtostr(buf, sizeof(buf),
+                                          gwy_brick_get_yreal(brick)));
+    g_string_append_printf(text, "zreal=%s\n",
+                           g_ascii_dtostr(buf, sizeof(buf),
+                                          gwy_brick_get_zreal(brick)));
+    append_unit(text, "xunit", gwy_brick_get_si_unit_x(brick));
+    append_unit(text, "yunit", gwy_brick_get_si_unit_y(brick));
+    append_unit(text, "zunit", gwy_brick_get_si_unit_z(brick));
+    append_unit(text, "valueunit", gwy_brick_get_si_unit_w(brick));
+
+    *size = text->len;
+    return g_string_free(text, FALSE);
+}
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */
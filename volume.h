@@ -0,0 +1,27 @@
+/*
+ *  volume.h
+ *  Copyright © 2012 François Bianco
+ *  Email: francois.bianco@unige.ch
+ *
+ *  This code is available under the GPL v3 or any later version
+ *
+ *  Export of volume data level by level, as images or a raw stack
+ *
+ */
+
+#ifndef __GWYEXPORT_VOLUME_H__
+#define __GWYEXPORT_VOLUME_H__
+
+#include <stdio.h>
+#include <libprocess/gwyprocess.h>
+
+GwyDataField* volume_level_new (GwyBrick *brick,
+                                gint level);
+gboolean      volume_write_raw (GwyBrick *brick,
+                                FILE *fp);
+gchar*        volume_describe  (GwyBrick *brick,
+                                gsize *size);
+
+#endif /* __GWYEXPORT_VOLUME_H__ */
+
+/* vim: set cin et ts=4 sw=4 cino=>1s,e0,n0,f0,{0,}0,^0,\:1s,=0,g1s,h0,t0,+1s,c3,(0,u0 : */